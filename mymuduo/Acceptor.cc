@@ -6,8 +6,14 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <linux/filter.h>
 #include <unistd.h>
 
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51 // linux 4.5
+#endif
+
 // 调用socket创建listenfd
 static int createNonblocking()
 {
@@ -20,11 +26,24 @@ static int createNonblocking()
     return sockfd;
 }
 
+static int openIdleFd()
+{
+    return ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
     : loop_(loop)
     , acceptSocket_(createNonblocking())  // 创建listenfd
     , acceptChannel_(loop,acceptSocket_.fd()) // listenfd封装成Channel
     , listenning_(false)
+    , socketListening_(false)
+    , exclusive_(false)
+    , maxAcceptsPerWakeup_(KDefaultMaxAcceptsPerWakeup)
+    , idleFd_(openIdleFd())
+    , overloadPauseSeconds_(KDefaultOverloadPauseSeconds)
+    , paused_(false)
+    , fdLimitRejections_(0)
+    , pauses_(0)
 {
     acceptSocket_.setReuseAddr(true);
     acceptSocket_.setReusePort(reuseport);
@@ -32,12 +51,73 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
     // 给channel注册的处理读事件的回调，其实就是listenfd处理新连接的回调
     acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead,this));
 }
+Acceptor::Acceptor(EventLoop *loop, int listenfd)
+    : loop_(loop)
+    , acceptSocket_(listenfd)
+    , acceptChannel_(loop, acceptSocket_.fd())
+    , listenning_(false)
+    , socketListening_(false)
+    , exclusive_(false)
+    , maxAcceptsPerWakeup_(KDefaultMaxAcceptsPerWakeup)
+    , idleFd_(openIdleFd())
+    , overloadPauseSeconds_(KDefaultOverloadPauseSeconds)
+    , paused_(false)
+    , fdLimitRejections_(0)
+    , pauses_(0)
+{
+    acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
+}
+
 Acceptor::~Acceptor()
 {
     // 取消所有关注的事件
     acceptChannel_.disableAll();
     // 从所属的poller中移除
     acceptChannel_.remove();
+    if (paused_)
+    {
+        loop_->cancel(resumeTimer_);
+    }
+    if (idleFd_ >= 0)
+    {
+        ::close(idleFd_);
+    }
+}
+
+void Acceptor::listenSocket()
+{
+    if (!socketListening_)
+    {
+        socketListening_ = true;
+        acceptSocket_.listen();
+    }
+}
+
+bool Acceptor::attachCpuSteering(const std::vector<int> &cpuToIndex, int numSockets)
+{
+    // A = 处理数据包的CPU，按cpuToIndex逐个比较，都不匹配时返回A % numSockets
+    std::vector<sock_filter> code;
+    code.push_back(sock_filter{BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)});
+    for (int cpu = 0; cpu < static_cast<int>(cpuToIndex.size()); ++cpu)
+    {
+        if (cpuToIndex[cpu] >= 0 && cpuToIndex[cpu] < numSockets)
+        {
+            code.push_back(sock_filter{BPF_JMP | BPF_JEQ | BPF_K, 0, 1, static_cast<uint32_t>(cpu)});
+            code.push_back(sock_filter{BPF_RET | BPF_K, 0, 0, static_cast<uint32_t>(cpuToIndex[cpu])});
+        }
+    }
+    code.push_back(sock_filter{BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(numSockets)});
+    code.push_back(sock_filter{BPF_RET | BPF_A, 0, 0, 0});
+
+    sock_fprog prog;
+    prog.len = static_cast<unsigned short>(code.size());
+    prog.filter = code.data();
+    if (::setsockopt(acceptSocket_.fd(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof prog) < 0)
+    {
+        LOG_ERROR("%s:%s:%d Acceptor::attachCpuSteering error %d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+        return false;
+    }
+    return true;
 }
 
 // 启动listenfd监听可读事件
@@ -45,39 +125,151 @@ void Acceptor::listen()
 {
     listenning_ = true;
     // listen
-    acceptSocket_.listen();
+    listenSocket();
     // 设置监听可读事件，其实就是开始监听新的连接的到来
-    acceptChannel_.enableReading();
+    enableAccepting();
+}
+
+void Acceptor::enableAccepting()
+{
+    if (exclusive_)
+    {
+        acceptChannel_.enableExclusiveReading();
+    }
+    else
+    {
+        acceptChannel_.enableReading();
+    }
 }
 
-// 回调函数
+void Acceptor::pause(double seconds)
+{
+    if (!listenning_ || paused_)
+    {
+        return;
+    }
+    paused_ = true;
+    pauses_.fetch_add(1, std::memory_order_relaxed);
+    acceptChannel_.disableAll();
+    resumeTimer_ = loop_->runAfter(seconds, std::bind(&Acceptor::resume, this));
+}
+
+void Acceptor::resume()
+{
+    paused_ = false;
+    if (listenning_)
+    { // 暂停期间可能已经stop了
+        enableAccepting();
+    }
+}
+
+// 停止监听listenfd
+void Acceptor::stop()
+{
+    if (!socketListening_)
+    {
+        return;
+    }
+    socketListening_ = false;
+    if (listenning_)
+    {
+        listenning_ = false;
+        acceptChannel_.disableAll();
+    }
+    if (paused_)
+    {
+        paused_ = false;
+        loop_->cancel(resumeTimer_);
+    }
+    // linux上对监听socket调用shutdown会关闭监听状态，客户端马上收到RST，可以去重试其他的服务器
+    // listenfd本身留到析构时再关闭；多个loop共享的socket可能已经被其他loop关闭了(ENOTCONN)
+    if (::shutdown(acceptSocket_.fd(), SHUT_RDWR) < 0 && errno != ENOTCONN)
+    {
+        LOG_ERROR("%s:%s:%d Acceptor::stop shutdown error %d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+}
+
+// 回调函数，一次唤醒最多处理maxAcceptsPerWakeup_个连接，直到没有等待的连接
 void Acceptor::handleRead()
 {
-    InetAddress peerAddr;
-    // 建立新的连接->其调用的就是linux上的accept函数
-    int confd = acceptSocket_.accept(&peerAddr);
-    if(confd >=0)
+    int accepted = 0;
+    // 被拒绝的连接也算在一次唤醒的上限里
+    for (int attempts = 0; attempts < maxAcceptsPerWakeup_; ++attempts)
     {
-        // 这个回调函数是由TcpServer提供，用来处理新的连接分发给subloop使用
-        if(newConnectionCallback_)
+        InetAddress peerAddr;
+        // 建立新的连接->其调用的就是linux上的accept4函数
+        int confd = acceptSocket_.accept(&peerAddr);
+        if (confd >= 0)
         {
-            // 对应TcpServer::newConnection
-            newConnectionCallback_(confd,peerAddr);
+            if (admissionCallback_ && !admissionCallback_(peerAddr))
+            { // 被准入控制拒绝，回调中可能暂停了接受
+                ::close(confd);
+                if (paused_)
+                {
+                    break;
+                }
+                continue;
+            }
+            ++accepted;
+            // 这个回调函数是由TcpServer提供，用来处理新的连接分发给subloop使用
+            if (newConnectionCallback_)
+            {
+                // 对应TcpServer::newConnection
+                newConnectionCallback_(confd, peerAddr);
+            }
+            else
+            {
+                // 如果没有处理新的连接就将这个连接关闭
+                ::close(confd);
+            }
+        }
+        else if (errno == EAGAIN)
+        { // 等待的连接都取完了，或者多个loop监听同一个listenfd时被其他loop取走了
+            break;
+        }
+        else if (errno == EINTR || errno == ECONNABORTED)
+        { // 连接在accept之前被对端重置，继续取下一个
+            continue;
+        }
+        else if (errno == EINVAL)
+        { // 共享的监听socket已经被其他loop停止，不再监听
+            acceptChannel_.disableAll();
+            listenning_ = false;
+            break;
+        }
+        else if (errno == EMFILE || errno == ENFILE)
+        { // 这个错误表示服务器的文件描述符达到上限，需要更高的并发
+            LOG_ERROR("%s:%s:%d Acceptor::handleRead sockfd reached error %d\n"
+                        , __FILE__, __FUNCTION__, __LINE__, errno);
+            shedConnection();
+            pause(overloadPauseSeconds_);
+            break;
         }
         else
         {
-            // 如果没有处理新的连接就将这个连接关闭
-            ::close(confd);
+            LOG_ERROR("in Acceptor::handleRead error %d\n", errno);
+            break;
         }
     }
-    else
+    if (accepted > 0 && acceptBatchCallback_)
+    { // 这一批连接都交给回调之后再统一分发
+        acceptBatchCallback_();
+    }
+}
+
+void Acceptor::shedConnection()
+{
+    if (idleFd_ < 0)
     {
-        LOG_ERROR("in Acceptor::handleRead error %d\n",errno);
-        if(errno == EMFILE)
-        {   // 这个错误表示服务器的文件描述符达到上限，需要更高的并发
-            LOG_ERROR("%s:%s:%d Acceptor::handleRead sockfd reached error %d\n"
-                        ,__FILE__,__FUNCTION__,__LINE__,errno);
-        }
+        return;
+    }
+    ::close(idleFd_);
+    int confd = ::accept(acceptSocket_.fd(), nullptr, nullptr);
+    if (confd >= 0)
+    {
+        ::close(confd);
+        fdLimitRejections_.fetch_add(1, std::memory_order_relaxed);
     }
-    
-}
\ No newline at end of file
+    // 其他线程可能抢先用掉了刚腾出的位置，这时下次再试
+    idleFd_ = openIdleFd();
+}
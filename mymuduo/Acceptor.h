@@ -2,8 +2,11 @@
 #include "noncopyable.h"
 #include "Socket.h"
 #include "Channel.h"
+#include "TimerId.h"
 
+#include <atomic>
 #include <functional>
+#include <vector>
 
 
 class EventLoop;
@@ -19,20 +22,73 @@ class Acceptor : noncpoyable
 
 public:
     using NewConnectionCallback = std::function<void(int sockfd,const InetAddress&)>;
+    // 一次唤醒接受的一批连接都交给NewConnectionCallback之后调用
+    using AcceptBatchCallback = std::function<void()>;
+    // 接受连接之后、交给NewConnectionCallback之前调用，返回false时直接关闭这个连接
+    using AdmissionCallback = std::function<bool(const InetAddress &)>;
+
+    static const int KDefaultMaxAcceptsPerWakeup = 64;
+    static constexpr double KDefaultOverloadPauseSeconds = 0.1;
 
     Acceptor(EventLoop *loop,const InetAddress &listenAddr,bool reuseport);
+    // 接管一个已经绑定好地址的listenfd(比如dup出来的)，析构时关闭
+    Acceptor(EventLoop *loop, int listenfd);
     ~Acceptor();
 
     void setNewConnectionCallback(const NewConnectionCallback&cb){newConnectionCallback_ = std::move(cb);}
+    void setAcceptBatchCallback(const AcceptBatchCallback &cb) { acceptBatchCallback_ = cb; }
+    // 每次可读事件最多接受的连接个数，剩下的等下一轮(水平触发会再次通知)，避免连接风暴时一直占着loop
+    void setMaxAcceptsPerWakeup(int n) { maxAcceptsPerWakeup_ = n > 0 ? n : 1; }
+    void setAdmissionCallback(const AdmissionCallback &cb) { admissionCallback_ = cb; }
+    // fd用完(EMFILE/ENFILE)时暂停接受连接的时间，避免水平触发下loop一直被唤醒空转
+    void setOverloadPause(double seconds) { overloadPauseSeconds_ = seconds; }
     bool listenning()const {return listenning_;}
+    int fd() const { return acceptSocket_.fd(); }
+    EventLoop *ownerLoop() const { return loop_; }
+
+    // 多个loop监听同一个listenfd时用EPOLLEXCLUSIVE注册，一个新连接只唤醒一个loop，在listen之前调用
+    void setExclusive(bool on) { exclusive_ = on; }
+
+    // 只让socket进入监听状态，不注册到loop，可以在任意线程调用
+    // SO_REUSEPORT的多个socket按进入监听状态的先后编号，需要固定编号时先依次调用这个函数
+    void listenSocket();
+    // 在SO_REUSEPORT组上挂一个CBPF程序，按处理数据包的CPU选择socket：
+    // cpuToIndex[cpu] >= 0时选编号为cpuToIndex[cpu]的socket，否则选cpu % numSockets
+    // 对组中任意一个已经监听的socket调用都对整个组生效，失败返回false
+    bool attachCpuSteering(const std::vector<int> &cpuToIndex, int numSockets);
+
     void listen();
+    // 停止监听，之后的连接请求被内核直接拒绝，已经建立的连接不受影响
+    void stop();
+    // 暂停接受连接，seconds秒之后自动恢复，期间的连接留在内核的全连接队列里，只能在loop线程中调用
+    void pause(double seconds);
+    bool paused() const { return paused_; }
+
+    // 因为fd用完被关闭的连接个数、暂停的次数，可以在任意线程读取
+    uint64_t fdLimitRejections() const { return fdLimitRejections_.load(std::memory_order_relaxed); }
+    uint64_t pauses() const { return pauses_.load(std::memory_order_relaxed); }
 private:
 
     void handleRead();
+    // fd用完时用预留的fd接受一个连接并马上关闭，客户端收到FIN而不是一直等在队列里
+    void shedConnection();
+    void resume();
+    void enableAccepting();
 
     EventLoop *loop_; // 这个loop就是mainloop，
     Socket acceptSocket_; // 这个是服务器对应的listenfd
     Channel acceptChannel_; // 这个是服务器对应的channel
     NewConnectionCallback newConnectionCallback_;
+    AcceptBatchCallback acceptBatchCallback_;
+    AdmissionCallback admissionCallback_;
     bool listenning_;
+    bool socketListening_; // socket已经进入监听状态
+    bool exclusive_;
+    int maxAcceptsPerWakeup_;
+    int idleFd_; // 预留的fd，fd用完时先关闭它腾出一个位置
+    double overloadPauseSeconds_;
+    bool paused_;
+    TimerId resumeTimer_;
+    std::atomic<uint64_t> fdLimitRejections_;
+    std::atomic<uint64_t> pauses_;
 };
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "Awaiter.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+
+#include <algorithm>
+#include <functional>
+
+// 条件已经满足或者连接已经断开时不挂起
+bool ConnectionAwaiter::await_ready() const
+{
+    return ready() || conn_->disconnected();
+}
+
+ConnectionAwaiter::~ConnectionAwaiter()
+{
+    if (waiting_)
+    {
+        conn_->clearWaiter(this);
+    }
+}
+
+void ConnectionAwaiter::waitRead()
+{
+    waiting_ = true;
+    conn_->setReadWaiter(this);
+}
+
+void ConnectionAwaiter::waitWrite()
+{
+    waiting_ = true;
+    conn_->setWriteWaiter(this);
+}
+
+bool ReadAtLeastAwaiter::ready() const
+{
+    return conn_->inputBuffer()->readableBytes() >= bytes_;
+}
+
+bool ReadUntilAwaiter::ready() const
+{
+    const Buffer *buf = conn_->inputBuffer();
+    const size_t readable = buf->firstChunkBytes();
+    if (delim_.empty() || readable < delim_.size())
+    {
+        return false;
+    }
+    // 分隔符可能跨在上次查找的末尾，往回退delim_.size() - 1个字节
+    const size_t start = scanned_ >= delim_.size() ? scanned_ - delim_.size() + 1 : 0;
+    const char *begin = buf->peek();
+    const char *end = begin + readable;
+    const char *pos = std::search(begin + start, end, delim_.begin(), delim_.end());
+    if (pos == end)
+    {
+        scanned_ = readable;
+        return false;
+    }
+    found_ = pos - begin + delim_.size();
+    return true;
+}
+
+bool FlushAwaiter::ready() const
+{
+    return conn_->outputIdle();
+}
+
+bool FlushAwaiter::await_resume() const
+{
+    return ready() && !conn_->disconnected();
+}
+
+SleepAwaiter::~SleepAwaiter()
+{
+    if (pending_)
+    {
+        loop_->cancel(timerId_);
+    }
+}
+
+void SleepAwaiter::start()
+{
+    if (loop_->isInLoopThread())
+    {
+        startInLoop();
+    }
+    else
+    { // 在其他线程直接runAfter的话，定时器可能在timerId_保存之前就到期，
+        // 协程恢复之后awaiter已经析构，所以定时器只在loop线程中创建和保存
+        loop_->runInLoop(std::bind(&SleepAwaiter::startInLoop, this));
+    }
+}
+
+void SleepAwaiter::startInLoop()
+{
+    pending_ = true;
+    timerId_ = loop_->runAfter(seconds_, std::bind(&SleepAwaiter::fire, this));
+}
+
+void SleepAwaiter::fire()
+{
+    pending_ = false;
+    resume();
+}
@@ -0,0 +1,175 @@
+#pragma once
+#include "TimerId.h"
+
+#include <stddef.h>
+#include <string>
+
+class EventLoop;
+class TcpConnection;
+
+/**
+ * 协程co_await的对象，库本身仍然用C++11编译，不依赖<coroutine>
+ * await_suspend是模板，把协程句柄转成地址和对应的恢复函数保存下来，
+ * 条件满足时在loop线程中直接恢复协程，不需要再唤醒loop
+ * awaiter保存在协程帧中，挂起期间不需要在堆上分配内存
+ * 用C++20编译的代码直接co_await即可，协程的任务类型见Coroutine.h
+ */
+class Awaiter
+{
+public:
+    // 恢复挂起的协程
+    void resume() { resumeFn_(handle_); }
+
+protected:
+    Awaiter() : handle_(nullptr), resumeFn_(nullptr) {}
+
+    template <typename Handle>
+    void setHandle(Handle handle)
+    {
+        handle_ = handle.address();
+        resumeFn_ = &resumeHandle<Handle>;
+    }
+
+private:
+    template <typename Handle>
+    static void resumeHandle(void *address)
+    {
+        Handle::from_address(address).resume();
+    }
+
+    void *handle_;
+    void (*resumeFn_)(void *);
+};
+
+/**
+ * 等待连接上的读写条件，只能在连接所属的loop线程中co_await
+ * 协程挂起期间连接上的数据不再交给messageCallback，而是留在inputBuffer中由协程读取
+ * 连接断开时挂起的协程也会被恢复，await_resume返回失败
+ * 挂起期间协程帧被销毁(比如CoTask被析构)时，析构函数把自己从连接上摘掉，连接不会再恢复它
+ */
+class ConnectionAwaiter : public Awaiter
+{
+public:
+    virtual ~ConnectionAwaiter();
+
+    // 等待的条件是否已经满足
+    virtual bool ready() const = 0;
+
+    bool await_ready() const;
+
+    // 以下由TcpConnection调用
+    // 恢复挂起的协程
+    void wake()
+    {
+        waiting_ = false;
+        resume();
+    }
+    // 连接析构，不再等待
+    void detach() { waiting_ = false; }
+
+protected:
+    explicit ConnectionAwaiter(TcpConnection *conn) : conn_(conn), waiting_(false) {}
+
+    // 挂起，等待读写事件
+    void waitRead();
+    void waitWrite();
+
+    TcpConnection *conn_;
+    bool waiting_; // 已经登记在连接上，还没有被恢复
+};
+
+// inputBuffer中至少有n个字节
+class ReadAtLeastAwaiter : public ConnectionAwaiter
+{
+public:
+    ReadAtLeastAwaiter(TcpConnection *conn, size_t n) : ConnectionAwaiter(conn), bytes_(n) {}
+
+    bool ready() const override;
+
+    template <typename Handle>
+    void await_suspend(Handle handle)
+    {
+        setHandle(handle);
+        waitRead();
+    }
+    // 读够返回true，连接断开返回false
+    bool await_resume() const { return ready(); }
+
+private:
+    size_t bytes_;
+};
+
+// inputBuffer中出现分隔符delim
+class ReadUntilAwaiter : public ConnectionAwaiter
+{
+public:
+    ReadUntilAwaiter(TcpConnection *conn, const std::string &delim)
+        : ConnectionAwaiter(conn), delim_(delim), scanned_(0), found_(0)
+    {
+    }
+
+    bool ready() const override;
+
+    template <typename Handle>
+    void await_suspend(Handle handle)
+    {
+        setHandle(handle);
+        waitRead();
+    }
+    // 返回到分隔符为止(包括分隔符)的数据长度，连接断开返回0
+    size_t await_resume() const { return ready() ? found_ : 0; }
+
+private:
+    std::string delim_;
+    // 已经查找过的位置，新数据到来时从这里继续找
+    mutable size_t scanned_;
+    mutable size_t found_;
+};
+
+// 已经交给连接的数据全部写到socket中
+class FlushAwaiter : public ConnectionAwaiter
+{
+public:
+    explicit FlushAwaiter(TcpConnection *conn) : ConnectionAwaiter(conn) {}
+
+    bool ready() const override;
+
+    template <typename Handle>
+    void await_suspend(Handle handle)
+    {
+        setHandle(handle);
+        waitWrite();
+    }
+    // 写完返回true，连接断开返回false
+    bool await_resume() const;
+};
+
+// 在loop上等待一段时间，可以在任意线程co_await，恢复时已经在loop线程中
+// 比如co_await loop->sleep(0)把协程切换到loop线程
+// 挂起期间协程帧被销毁时取消定时器，需要在loop线程中销毁
+class SleepAwaiter : public Awaiter
+{
+public:
+    SleepAwaiter(EventLoop *loop, double seconds) : loop_(loop), seconds_(seconds), pending_(false) {}
+    ~SleepAwaiter();
+
+    bool await_ready() const { return false; }
+
+    template <typename Handle>
+    void await_suspend(Handle handle)
+    {
+        setHandle(handle);
+        start();
+    }
+    void await_resume() const {}
+
+private:
+    void start();
+    void startInLoop();
+    void fire();
+
+    EventLoop *loop_;
+    double seconds_;
+    bool pending_; // 定时器还没有到期
+    TimerId timerId_;
+};
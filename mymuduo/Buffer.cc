@@ -1,11 +1,54 @@
 #include "Buffer.h"
+#include <errno.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
+Buffer::Buffer(const Buffer &rhs)
+    : buffer_(rhs.buffer_)
+    , readIndex_(rhs.readIndex_)
+    , writeIndex_(rhs.writeIndex_)
+    , pool_(rhs.pool_)
+    , head_(nullptr)
+    , tail_(nullptr)
+    , chainBytes_(0)
+{
+    // 分段模式下把数据逐块拷贝到新的链表中
+    for (BufferBlock *block = rhs.head_; block != nullptr; block = block->next)
+    {
+        appendChain(block->data + block->readIndex, block->readableBytes());
+    }
+}
+
+Buffer &Buffer::operator=(const Buffer &rhs)
+{
+    if (this != &rhs)
+    {
+        Buffer tmp(rhs);
+        swap(tmp);
+    }
+    return *this;
+}
+
+void Buffer::swap(Buffer &rhs)
+{
+    buffer_.swap(rhs.buffer_);
+    std::swap(readIndex_, rhs.readIndex_);
+    std::swap(writeIndex_, rhs.writeIndex_);
+    pool_.swap(rhs.pool_);
+    std::swap(head_, rhs.head_);
+    std::swap(tail_, rhs.tail_);
+    std::swap(chainBytes_, rhs.chainBytes_);
+}
+
 // 从fd上读取数据
 ssize_t Buffer::readFd(int fd, int *savedErrno)
 {
-    char extrabuf[65536] = {0}; // 64K的栈上数组
+    if (chained())
+    {
+        return readFdChain(fd, savedErrno);
+    }
+
+    char extrabuf[KMaxReadBytes]; // 64K的栈上数组
     iovec vec[2];
     const size_t writebale = writableBytes();
     vec[0].iov_base = begin() + writeIndex_;
@@ -21,7 +64,7 @@ ssize_t Buffer::readFd(int fd, int *savedErrno)
     { // 出错并将错误带回
         *savedErrno = errno;
     }
-    else if (n <= writebale)
+    else if (static_cast<size_t>(n) <= writebale)
     { // buffer本身的缓冲区够用
         writeIndex_ += n;
     }
@@ -36,10 +79,284 @@ ssize_t Buffer::readFd(int fd, int *savedErrno)
 // 将缓冲区的数据写入fd
 ssize_t Buffer::writeFd(int fd, int *savedErrno)
 {
-    size_t n = ::write(fd,peek(),readableBytes());
-    if(n < 0)
+    return writeFd(fd, savedErrno, readableBytes());
+}
+
+// 将缓冲区中前maxBytes长度的数据写入fd
+ssize_t Buffer::writeFd(int fd, int *savedErrno, size_t maxBytes)
+{
+    if (chained())
+    {
+        return writeFdChain(fd, savedErrno, maxBytes);
+    }
+
+    ssize_t n = ::write(fd, peek(), std::min(maxBytes, readableBytes()));
+    if (n < 0)
     {
         *savedErrno = errno;
     }
     return n;
-}
\ No newline at end of file
+}
+
+// 用可读数据填充iovec数组
+int Buffer::peekIovec(iovec *vec, int maxcnt) const
+{
+    int iovcnt = 0;
+    if (!chained())
+    {
+        if (maxcnt > 0 && readableBytes() > 0)
+        {
+            vec[0].iov_base = const_cast<char *>(peek());
+            vec[0].iov_len = readableBytes();
+            iovcnt = 1;
+        }
+        return iovcnt;
+    }
+    for (BufferBlock *block = head_; block != nullptr && iovcnt < maxcnt; block = block->next)
+    {
+        vec[iovcnt].iov_base = block->data + block->readIndex;
+        vec[iovcnt].iov_len = block->readableBytes();
+        ++iovcnt;
+    }
+    return iovcnt;
+}
+
+// 分段模式追加数据：填满尾块后从pool中取新块挂到链表尾部，已有的数据不会移动
+void Buffer::appendChain(const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        if (tail_ == nullptr || tail_->writableBytes() == 0)
+        {
+            BufferBlock *block = pool_->allocate();
+            if (tail_)
+            {
+                tail_->next = block;
+            }
+            else
+            {
+                head_ = block;
+            }
+            tail_ = block;
+        }
+        size_t n = std::min(len, tail_->writableBytes());
+        std::copy(data, data + n, tail_->data + tail_->writeIndex);
+        tail_->writeIndex += n;
+        chainBytes_ += n;
+        data += n;
+        len -= n;
+    }
+}
+
+// 移走other中的所有数据
+void Buffer::append(Buffer &&other)
+{
+    if (this == &other)
+    {
+        return;
+    }
+    if (chained() && other.chained())
+    { // 所有的块大小都相同，可以直接挂到当前链表的尾部，以后还给当前Buffer的pool
+        if (other.head_)
+        {
+            if (tail_)
+            {
+                tail_->next = other.head_;
+            }
+            else
+            {
+                head_ = other.head_;
+            }
+            tail_ = other.tail_;
+            chainBytes_ += other.chainBytes_;
+            other.head_ = nullptr;
+            other.tail_ = nullptr;
+            other.chainBytes_ = 0;
+        }
+        return;
+    }
+    iovec vec[KMaxWriteBlocks];
+    int iovcnt = 0;
+    while ((iovcnt = other.peekIovec(vec, KMaxWriteBlocks)) > 0)
+    {
+        size_t len = 0;
+        for (int i = 0; i < iovcnt; ++i)
+        {
+            append(static_cast<const char *>(vec[i].iov_base), vec[i].iov_len);
+            len += vec[i].iov_len;
+        }
+        other.retrieve(len);
+    }
+}
+
+// 分段模式读走len长度的数据，读完的块还给pool
+void Buffer::retrieveChain(size_t len)
+{
+    if (len >= chainBytes_)
+    {
+        releaseChain();
+        return;
+    }
+    chainBytes_ -= len;
+    while (len > 0)
+    {
+        size_t n = std::min(len, head_->readableBytes());
+        head_->readIndex += n;
+        len -= n;
+        if (head_->readableBytes() == 0)
+        {
+            BufferBlock *block = head_;
+            head_ = block->next;
+            pool_->deallocate(block);
+        }
+    }
+    if (head_ == nullptr)
+    {
+        tail_ = nullptr;
+    }
+}
+
+// 分段模式把前len长度的数据拷贝到result中
+void Buffer::copyChain(std::string *result, size_t len) const
+{
+    len = std::min(len, chainBytes_);
+    result->reserve(len);
+    for (BufferBlock *block = head_; block != nullptr && len > 0; block = block->next)
+    {
+        size_t n = std::min(len, block->readableBytes());
+        result->append(block->data + block->readIndex, n);
+        len -= n;
+    }
+}
+
+// 将链表中所有的块还给pool
+void Buffer::releaseChain()
+{
+    while (head_)
+    {
+        BufferBlock *block = head_;
+        head_ = block->next;
+        pool_->deallocate(block);
+    }
+    tail_ = nullptr;
+    chainBytes_ = 0;
+}
+
+// 分段模式读数据：尾块剩余空间加上若干新块组成iovec，readv直接读到链表中
+ssize_t Buffer::readFdChain(int fd, int *savedErrno)
+{
+    static const int KSpareBlocks = KMaxReadBytes / BufferBlock::KBlockSize;
+    iovec vec[KSpareBlocks + 1];
+    BufferBlock *spare[KSpareBlocks];
+    int iovcnt = 0;
+
+    const size_t tailWritable = writableBytes();
+    if (tailWritable > 0)
+    {
+        vec[iovcnt].iov_base = tail_->data + tail_->writeIndex;
+        vec[iovcnt].iov_len = tailWritable;
+        ++iovcnt;
+    }
+    for (int i = 0; i < KSpareBlocks; ++i)
+    {
+        spare[i] = pool_->allocate();
+        vec[iovcnt].iov_base = spare[i]->data;
+        vec[iovcnt].iov_len = BufferBlock::KBlockSize;
+        ++iovcnt;
+    }
+
+    const ssize_t n = ::readv(fd, vec, iovcnt);
+    if (n < 0)
+    {
+        *savedErrno = errno;
+    }
+
+    size_t left = n > 0 ? static_cast<size_t>(n) : 0;
+    chainBytes_ += left;
+    if (tailWritable > 0)
+    {
+        size_t used = std::min(left, tailWritable);
+        tail_->writeIndex += used;
+        left -= used;
+    }
+    // 把读到数据的新块挂到链表尾部，没用到的块还给pool
+    for (int i = 0; i < KSpareBlocks; ++i)
+    {
+        if (left > 0)
+        {
+            size_t used = std::min(left, BufferBlock::KBlockSize);
+            spare[i]->writeIndex = used;
+            left -= used;
+            if (tail_)
+            {
+                tail_->next = spare[i];
+            }
+            else
+            {
+                head_ = spare[i];
+            }
+            tail_ = spare[i];
+        }
+        else
+        {
+            pool_->deallocate(spare[i]);
+        }
+    }
+    return n;
+}
+
+// 分段模式写数据：每个块对应一个iovec，每次writev最多KMaxWriteBlocks个块，
+// 一直写到maxBytes写完或者socket写满，所以返回值小于maxBytes就说明socket已经写满了
+ssize_t Buffer::writeFdChain(int fd, int *savedErrno, size_t maxBytes)
+{
+    maxBytes = std::min(maxBytes, chainBytes_);
+    size_t written = 0;
+    BufferBlock *block = head_;
+    size_t blockOffset = 0; // block中已经写出的长度
+    while (written < maxBytes)
+    {
+        iovec vec[KMaxWriteBlocks];
+        int iovcnt = 0;
+        size_t batch = 0;
+        for (BufferBlock *b = block; b != nullptr && iovcnt < KMaxWriteBlocks && written + batch < maxBytes; b = b->next)
+        {
+            size_t offset = b == block ? blockOffset : 0;
+            size_t len = std::min(b->readableBytes() - offset, maxBytes - written - batch);
+            vec[iovcnt].iov_base = b->data + b->readIndex + offset;
+            vec[iovcnt].iov_len = len;
+            ++iovcnt;
+            batch += len;
+        }
+
+        ssize_t n = ::writev(fd, vec, iovcnt);
+        if (n < 0)
+        {
+            if (written > 0)
+            { // 已经写出了一部分，错误留到下一次写的时候处理
+                break;
+            }
+            *savedErrno = errno;
+            return n;
+        }
+        written += n;
+        if (static_cast<size_t>(n) < batch)
+        { // socket已经写满
+            break;
+        }
+        // 跳过已经写出的块
+        size_t left = n;
+        while (left > 0)
+        {
+            size_t avail = block->readableBytes() - blockOffset;
+            if (left < avail)
+            {
+                blockOffset += left;
+                break;
+            }
+            left -= avail;
+            block = block->next;
+            blockOffset = 0;
+        }
+    }
+    return written;
+}
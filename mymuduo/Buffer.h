@@ -1,10 +1,21 @@
 #pragma once
 
+#include "BufferPool.h"
+
 #include <algorithm>
+#include <memory>
 #include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
 #include <vector>
 
-// 服务器端接收数据使用的缓冲区类Buffer
+/**
+ * 服务器端接收数据使用的缓冲区类Buffer
+ * 两种存储模式：
+ *  1、连续模式(默认) 数据保存在一个vector<char>中，peek()可以看到全部可读数据
+ *  2、分段模式 数据保存在从BufferPool取出的定长块组成的链表中，
+ *     append永远不会搬动已经保存的数据，适合堆积大量待发送数据的outputBuffer_
+ */
 class Buffer
 {
 public:
@@ -17,28 +28,84 @@ public:
         : buffer_(KCheapPrepend + initialSize)
         , readIndex_(KCheapPrepend)
         , writeIndex_(KCheapPrepend)
+        , head_(nullptr)
+        , tail_(nullptr)
+        , chainBytes_(0)
+    {
+    }
+
+    // 分段模式的Buffer，数据块都从pool中取
+    explicit Buffer(const std::shared_ptr<BufferPool> &pool)
+        : readIndex_(KCheapPrepend)
+        , writeIndex_(KCheapPrepend)
+        , pool_(pool)
+        , head_(nullptr)
+        , tail_(nullptr)
+        , chainBytes_(0)
     {
     }
 
+    Buffer(const Buffer &rhs);
+    Buffer &operator=(const Buffer &rhs);
+    ~Buffer() { releaseChain(); }
+
+    void swap(Buffer &rhs);
+
+    // 是否是分段模式
+    bool chained() const { return pool_ != nullptr; }
+
     // 缓冲区中可读数据的长度
-    size_t readableBytes() const { return writeIndex_ - readIndex_; }
+    size_t readableBytes() const { return chained() ? chainBytes_ : writeIndex_ - readIndex_; }
 
-    // 缓冲区中可写的大小
-    size_t writableBytes() const { return buffer_.size() - writeIndex_; }
+    // 缓冲区中可写的大小(分段模式下为尾块剩余的空间)
+    size_t writableBytes() const
+    {
+        if (chained())
+        {
+            return tail_ ? tail_->writableBytes() : 0;
+        }
+        return buffer_.size() - writeIndex_;
+    }
 
     //
     size_t prependableBytes() const { return readIndex_; }
 
     // 返回缓冲区中可读数据的起始地址
-    const char *peek() const { return begin() + readIndex_; }
+    // 分段模式下只能看到第一个块中的数据，长度为firstChunkBytes()
+    const char *peek() const
+    {
+        if (chained())
+        {
+            return head_ ? head_->data + head_->readIndex : nullptr;
+        }
+        return begin() + readIndex_;
+    }
+
+    // peek()开始的连续可读数据长度
+    size_t firstChunkBytes() const
+    {
+        if (chained())
+        {
+            return head_ ? head_->readableBytes() : 0;
+        }
+        return readableBytes();
+    }
+
+    // 用可读数据填充最多maxcnt个iovec，返回使用的个数，用于writev
+    // 连续模式只需要一个iovec，分段模式每个块一个iovec
+    int peekIovec(iovec *vec, int maxcnt) const;
 
     // 调整readIndex_的位置
     void retrieve(size_t len)
     {
-        if (len < readableBytes())
+        if (chained())
+        {
+            retrieveChain(len);
+        }
+        else if (len < readableBytes())
         { // 读取小于可读数据长度的len数据，
             // 就将readIndex_的位置向后调整
-            readIndex_ + len;
+            readIndex_ += len;
         }
         else
         { // 读取所有的数据后将readIndex_和writeIndex_复位
@@ -49,6 +116,10 @@ public:
     // 将readIndex_和writeIndex_复位
     void retrieveAll()
     {
+        if (chained())
+        {
+            releaseChain();
+        }
         readIndex_ = KCheapPrepend;
         writeIndex_ = KCheapPrepend;
     }
@@ -62,12 +133,20 @@ public:
     // 读取len长度的数据
     std::string retrieveAsString(size_t len)
     {
-        std::string result(peek(), len);
+        std::string result;
+        if (chained())
+        {
+            copyChain(&result, len);
+        }
+        else
+        {
+            result.assign(peek(), len);
+        }
         retrieve(len); // 调整readIndex_的位置
         return result; // 返回读取结果
     }
 
-    // 需要写入的数据长度len和缓冲区中可用的长度比较
+    // 需要写入的数据长度len和缓冲区中可用的长度比较(连续模式使用)
     void ensureWritableBytes(size_t len)
     {
         if (writableBytes() < len)
@@ -77,6 +156,7 @@ public:
         }
     }
 
+    // 连续模式使用
     char* beginWrite()
     {
         return begin() + writeIndex_;
@@ -90,16 +170,43 @@ public:
     // 向缓冲区中写入数据
     void append(const char *data, size_t len)
     {
+        if (chained())
+        {
+            appendChain(data, len);
+            return;
+        }
         ensureWritableBytes(len);
         std::copy(data, data + len, beginWrite());
         writeIndex_ += len;
     }
 
+    // 把other中的数据全部移到当前Buffer的尾部，并清空other
+    // 两个Buffer都是分段模式时直接把other的块链接过来，不拷贝数据
+    void append(Buffer &&other);
+
+    // readFd一次最多能读取的数据长度，读到的比它少说明fd中的数据已经读完了
+    size_t readCapacity() const
+    {
+        const size_t writable = writableBytes();
+        if (chained())
+        { // 尾块剩余的空间加上KMaxReadBytes大小的新块
+            return writable + KMaxReadBytes;
+        }
+        return writable < KMaxReadBytes ? writable + KMaxReadBytes : writable;
+    }
+
     // 从fd上读取数据
     ssize_t readFd(int fd, int *savedErrno);
     // 向fd上写数据
     ssize_t writeFd(int fd,int *savedErrno);
+    // 向fd上最多写maxBytes长度的数据
+    ssize_t writeFd(int fd, int *savedErrno, size_t maxBytes);
 private:
+    // readFd一次最多读取的数据大小
+    static const size_t KMaxReadBytes = 65536;
+    // writeFd一次writev最多使用的块数
+    static const int KMaxWriteBlocks = 64;
+
     // 返回缓冲区起始地址的下标
     char *begin() { return &*buffer_.begin(); }
     const char *begin() const { return &*buffer_.begin(); }
@@ -124,7 +231,20 @@ private:
         }
     }
 
+    // 分段模式的实现
+    void appendChain(const char *data, size_t len);
+    void retrieveChain(size_t len);
+    void copyChain(std::string *result, size_t len) const;
+    void releaseChain();
+    ssize_t readFdChain(int fd, int *savedErrno);
+    ssize_t writeFdChain(int fd, int *savedErrno, size_t maxBytes);
+
     std::vector<char> buffer_;
     size_t readIndex_;
     size_t writeIndex_;
-};
\ No newline at end of file
+
+    std::shared_ptr<BufferPool> pool_; // 不为空表示分段模式
+    BufferBlock *head_;                // 第一个数据块(读端)
+    BufferBlock *tail_;                // 最后一个数据块(写端)
+    size_t chainBytes_;                // 链表中可读数据的总长度
+};
@@ -0,0 +1,57 @@
+#include "BufferPool.h"
+#include "CurrentThread.h"
+
+const size_t BufferBlock::KBlockSize;
+
+BufferPool::BufferPool(size_t maxFreeBlocks)
+    : freeList_(nullptr)
+    , freeCount_(0)
+    , maxFreeBlocks_(maxFreeBlocks)
+    , threadId_(CurrentThread::tid())
+{
+}
+
+BufferPool::~BufferPool()
+{
+    while (freeList_)
+    {
+        BufferBlock *block = freeList_;
+        freeList_ = block->next;
+        delete block;
+    }
+}
+
+// 取出一个空块，loop线程优先复用空闲链表中的块
+BufferBlock *BufferPool::allocate()
+{
+    BufferBlock *block = nullptr;
+    if (freeList_ && threadId_ == CurrentThread::tid())
+    {
+        block = freeList_;
+        freeList_ = block->next;
+        --freeCount_;
+    }
+    else
+    {
+        block = new BufferBlock;
+    }
+    block->next = nullptr;
+    block->readIndex = 0;
+    block->writeIndex = 0;
+    return block;
+}
+
+// 归还一个块，空闲链表已满或者不在loop线程时直接释放
+void BufferPool::deallocate(BufferBlock *block)
+{
+    if (freeCount_ < maxFreeBlocks_ && threadId_ == CurrentThread::tid())
+    {
+        block->next = freeList_;
+        freeList_ = block;
+        ++freeCount_;
+    }
+    else
+    {
+        delete block;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "noncopyable.h"
+
+#include <stddef.h>
+#include <unistd.h> // pid_t
+
+/**
+ * 分段Buffer使用的定长数据块
+ * 多个块通过next串成一条链，块内用readIndex/writeIndex标记可读区间
+ */
+struct BufferBlock
+{
+    // 每个块可以保存的数据大小
+    static const size_t KBlockSize = 16 * 1024;
+
+    BufferBlock *next;
+    size_t readIndex;
+    size_t writeIndex;
+    char data[KBlockSize];
+
+    size_t readableBytes() const { return writeIndex - readIndex; }
+    size_t writableBytes() const { return KBlockSize - writeIndex; }
+};
+
+/**
+ * BufferPool是每个EventLoop独有的数据块空闲链表
+ * 分段Buffer从这里取块、用完再还回来，稳定运行时不再向系统申请内存
+ * 只有创建它的loop线程才会使用空闲链表，其他线程申请和归还块时直接new/delete
+ */
+class BufferPool : noncpoyable
+{
+public:
+    // 空闲链表中最多缓存的块数(默认64 * 16K = 1M)
+    static const size_t KDefaultMaxFreeBlocks = 64;
+
+    explicit BufferPool(size_t maxFreeBlocks = KDefaultMaxFreeBlocks);
+    ~BufferPool();
+
+    // 取出一个空块
+    BufferBlock *allocate();
+    // 归还一个块
+    void deallocate(BufferBlock *block);
+
+    // 空闲链表中缓存的块数
+    size_t freeBlocks() const { return freeCount_; }
+
+private:
+    BufferBlock *freeList_; // 空闲块链表
+    size_t freeCount_;      // 空闲块个数
+    const size_t maxFreeBlocks_;
+    const pid_t threadId_;  // 创建pool的线程(loop线程)
+};
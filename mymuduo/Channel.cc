@@ -1,11 +1,15 @@
 #include "Channel.h"
 #include "EventLoop.h"
+#include "LoopActivity.h"
 #include <sys/epoll.h>
 
 // 用三个变量表示事件
 const int Channel::KNoneEvent = 0;
 const int Channel::KReadEvent = EPOLLIN | EPOLLPRI;
 const int Channel::KWriteEvent = EPOLLOUT;
+const int Channel::KEdgeEvent = EPOLLET;
+// EPOLLEXCLUSIVE不能和EPOLLPRI一起使用
+const int Channel::KExclusiveEvent = EPOLLIN | EPOLLEXCLUSIVE;
 
 Channel::Channel(EventLoop *loop, int fd)
     : loop_(loop),
@@ -13,6 +17,10 @@ Channel::Channel(EventLoop *loop, int fd)
       events_(0),
       revents_(0),
       index_(-1),
+      name_(nullptr),
+      edgeTriggered_(false),
+      writing_(false),
+      updateSlot_(-1),
       tied_(false)
 {
 }
@@ -73,6 +81,7 @@ void Channel::handlerEventWithGuard(Timestamp receiveTime)
     {
         if(closeCallback_)
         {
+            LoopActivity::Scope scope(loop_->activity(), LoopActivity::KCloseCallback, fd_, name_);
             closeCallback_();
         }
     } 
@@ -82,6 +91,7 @@ void Channel::handlerEventWithGuard(Timestamp receiveTime)
     {
         if(errorCallback_)
         {
+            LoopActivity::Scope scope(loop_->activity(), LoopActivity::KErrorCallback, fd_, name_);
             errorCallback_();
         }
     }
@@ -91,15 +101,17 @@ void Channel::handlerEventWithGuard(Timestamp receiveTime)
     {
         if(readCallback_)
         {
+            LoopActivity::Scope scope(loop_->activity(), LoopActivity::KReadCallback, fd_, name_);
             readCallback_(receiveTime);
         }
     }
 
-    // 可写事件
-    if(revents_ & EPOLLOUT)
+    // 可写事件，边沿触发模式下没有数据等待发送时忽略
+    if((revents_ & EPOLLOUT) && (!edgeTriggered_ || writing_))
     {
         if(writeCallback_)
         {
+            LoopActivity::Scope scope(loop_->activity(), LoopActivity::KWriteCallback, fd_, name_);
             writeCallback_();
         }
     }
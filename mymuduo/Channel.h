@@ -1,6 +1,7 @@
 #pragma once
 #include <functional>
 #include <memory>
+#include <string>
 
 #include "Timestamp.h"
 #include "noncopyable.h"
@@ -58,8 +59,8 @@ public:
     void set_revents(int revt) { revents_ = revt; }
     // 是否有感兴趣的事件
     bool isNoneEvent() const { return events_ == KNoneEvent; }
-    // 是否关注写事件
-    bool isWriteing() const { return events_ & KWriteEvent; }
+    // 是否关注写事件(边沿触发模式下是有没有数据等待发送)
+    bool isWriteing() const { return edgeTriggered_ ? writing_ : (events_ & KWriteEvent); }
     // 是否关注读时间
     bool isReading() const { return events_ & KReadEvent; }
 
@@ -78,12 +79,22 @@ public:
     // 给sockfd添加写事件监听
     void enableWriting()
     {
+        if (edgeTriggered_)
+        { // 写事件已经注册过了，只需要修改标记
+            writing_ = true;
+            return;
+        }
         events_ |= KWriteEvent;
         update();
     }
     // 取消sockfd的写事件监听
     void disableWriting()
     {
+        if (edgeTriggered_)
+        {
+            writing_ = false;
+            return;
+        }
         events_ &= ~KWriteEvent;
         update();
     }
@@ -91,13 +102,43 @@ public:
     void disableAll()
     {
         events_ = KNoneEvent;
+        writing_ = false;
         update();
     }
 
+    // 边沿触发模式：读写事件和EPOLLET一次注册到poller中，
+    // 之后enableWriting/disableWriting只修改标记，不再调用epoll_ctl
+    void enableEdgeTriggered()
+    {
+        writing_ = isWriteing();
+        edgeTriggered_ = true;
+        events_ |= KReadEvent | KWriteEvent | KEdgeEvent;
+        update();
+    }
+    bool edgeTriggered() const { return edgeTriggered_; }
+
+    // 多个loop监听同一个fd(比如同一个listenfd)时使用EPOLLEXCLUSIVE注册读事件，
+    // 事件到来时内核只唤醒其中一个(或少数几个)loop，注册之后只能disableAll，不能再修改关注的事件
+    void enableExclusiveReading()
+    {
+        events_ = KExclusiveEvent;
+        update();
+    }
+
+    // EventLoop使用，记录channel在等待更新列表中的下标，本轮循环结束时统一更新到poller中
+    // -1表示不在列表中
+    bool updatePending() const { return updateSlot_ >= 0; }
+    int updateSlot() const { return updateSlot_; }
+    void setUpdateSlot(int slot) { updateSlot_ = slot; }
+
     //
     int index() const { return index_; }
     void set_index(int idx) { index_ = idx; }
 
+    // channel所属连接的名字，看门狗报告卡住的回调时使用
+    // 只保存指针，name必须比channel存在得更久(比如TcpConnection的name_)
+    void setName(const std::string &name) { name_ = &name; }
+
     // 返回当前Channel所属的EventLoop
     EventLoop *ownerLoop() { return loop_; }
     // 从Channel所属的EventLoop中删除当前的Channel
@@ -114,12 +155,19 @@ private:
     static const int KNoneEvent; // 没有关心的事件
     static const int KReadEvent; // 关心读事件
     static const int KWriteEvent;// 关心写事件
+    static const int KEdgeEvent; // 边沿触发
+    static const int KExclusiveEvent; // 独占唤醒的读事件
 
     EventLoop *loop_; // 事件循环
     const int fd_;    // fd Poller监听的对象
     int events_;      // 注册fd感兴趣的事件
     int revents_;     // fd发生的事件
     int index_;       // poller使用的
+    const std::string *name_; // 所属连接的名字，可以为nullptr
+
+    bool edgeTriggered_; // 是否是边沿触发模式
+    bool writing_;       // 边沿触发模式下是否有数据等待可写事件
+    int updateSlot_;     // 在EventLoop等待更新的列表中的下标
 
     // 其实tie_指向的是当前channel对应的TcpConnection对象
     std::weak_ptr<void> tie_; 
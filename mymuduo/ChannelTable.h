@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class Channel;
+
+/**
+ * Poller中保存Channel的表
+ * fd都是比较小并且连续的整数，直接用fd作为vector的下标，查找不需要计算hash，增删不需要分配节点
+ * 每个位置记录一个编号，fd每次注册新的Channel编号加1，
+ * 内核事件中带上编号，可以识别出fd被关闭又复用之后还残留的旧事件
+ */
+class ChannelTable
+{
+public:
+    ChannelTable() : size_(0) {}
+
+    // 注册fd对应的channel，返回这次注册的编号
+    uint32_t add(int fd, Channel *channel)
+    {
+        const size_t index = static_cast<size_t>(fd);
+        if (index >= slots_.size())
+        { // 按2倍扩容，fd的最大值稳定以后不会再分配内存
+            slots_.resize(std::max(index + 1, slots_.size() * 2));
+        }
+        Slot &slot = slots_[index];
+        if (slot.channel == nullptr)
+        {
+            ++size_;
+        }
+        slot.channel = channel;
+        slot.events = 0;
+        return ++slot.generation;
+    }
+
+    // 删除fd对应的channel，编号保留，下次注册时继续增加
+    void remove(int fd)
+    {
+        const size_t index = static_cast<size_t>(fd);
+        if (index < slots_.size() && slots_[index].channel != nullptr)
+        {
+            slots_[index].channel = nullptr;
+            --size_;
+        }
+    }
+
+    // 返回fd对应的channel，没有注册返回nullptr
+    Channel *find(int fd) const
+    {
+        const size_t index = static_cast<size_t>(fd);
+        return index < slots_.size() ? slots_[index].channel : nullptr;
+    }
+
+    // 只有编号相同时才返回fd对应的channel，用来丢弃旧的事件
+    Channel *find(int fd, uint32_t generation) const
+    {
+        const size_t index = static_cast<size_t>(fd);
+        if (index < slots_.size() && slots_[index].generation == generation)
+        {
+            return slots_[index].channel;
+        }
+        return nullptr;
+    }
+
+    // fd当前的注册编号
+    uint32_t generation(int fd) const
+    {
+        const size_t index = static_cast<size_t>(fd);
+        return index < slots_.size() ? slots_[index].generation : 0;
+    }
+
+    // poller中登记的fd关注的事件，用来跳过没有变化的更新
+    int events(int fd) const
+    {
+        const size_t index = static_cast<size_t>(fd);
+        return index < slots_.size() ? slots_[index].events : 0;
+    }
+    void setEvents(int fd, int events)
+    {
+        const size_t index = static_cast<size_t>(fd);
+        if (index < slots_.size())
+        {
+            slots_[index].events = events;
+        }
+    }
+
+    // 注册的channel个数
+    size_t size() const { return size_; }
+
+private:
+    struct Slot
+    {
+        Slot() : channel(nullptr), generation(0), events(0) {}
+        Channel *channel;
+        uint32_t generation;
+        int events;
+    };
+
+    std::vector<Slot> slots_;
+    size_t size_;
+};
@@ -0,0 +1,253 @@
+#include "ComputePool.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+
+#include <stdio.h>
+
+// 当前线程是哪个池的第几个工作线程，工作线程中提交的任务直接放到自己的队列
+static thread_local ComputePool *t_pool = nullptr;
+static thread_local int t_workerIndex = -1;
+
+ComputePool::ComputePool(int numThreads, const std::string &name)
+    : numThreads_(numThreads > 0 ? numThreads : 1)
+    , name_(name)
+    , maxOutstanding_(KDefaultMaxOutstanding)
+    , running_(false)
+    , next_(0)
+    , sleepers_(0)
+    , queued_(0)
+    , submitted_(0)
+    , completed_(0)
+    , stolen_(0)
+    , throttled_(0)
+{
+    for (int i = 0; i < numThreads_; ++i)
+    {
+        workers_.emplace_back(new Worker);
+    }
+}
+
+ComputePool::~ComputePool()
+{
+    stop();
+    // 正常情况下队列已经空了，防御性地释放剩下的任务
+    for (std::unique_ptr<Worker> &worker : workers_)
+    {
+        for (Job *job : worker->jobs)
+        {
+            delete job;
+        }
+        worker->jobs.clear();
+    }
+}
+
+void ComputePool::start()
+{
+    if (running_.exchange(true))
+    {
+        return;
+    }
+    for (int i = 0; i < numThreads_; ++i)
+    {
+        char buf[name_.size() + 32] = {0};
+        snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
+        workers_[i]->thread.reset(new Thread(std::bind(&ComputePool::threadFunc, this, i), buf));
+        workers_[i]->thread->start();
+    }
+}
+
+void ComputePool::stop()
+{
+    if (!running_.exchange(false))
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(idleMutex_);
+    }
+    idleCond_.notify_all();
+    for (std::unique_ptr<Worker> &worker : workers_)
+    {
+        if (worker->thread)
+        {
+            worker->thread->join();
+        }
+    }
+}
+
+void ComputePool::submit(Task job)
+{
+    Job *item = new Job;
+    item->work = std::move(job);
+    item->loop = nullptr;
+    push(item);
+}
+
+void ComputePool::submit(EventLoop *loop, Task job, Task done)
+{
+    Job *item = new Job;
+    item->work = std::move(job);
+    item->done = std::move(done);
+    item->loop = loop;
+    push(item);
+}
+
+void ComputePool::submit(const TcpConnectionPtr &conn, Task job, Task done)
+{
+    const int outstanding = conn->outstandingJobs() + 1;
+    conn->setOutstandingJobs(outstanding);
+    if (outstanding >= maxOutstanding_ && conn->isReading())
+    { // 任务太多，先不读这个连接的新数据
+        conn->stopRead();
+        conn->setComputeThrottled(true);
+        ++throttled_;
+    }
+    Job *item = new Job;
+    item->work = std::move(job);
+    item->done = std::move(done);
+    item->loop = conn->getLoop();
+    item->conn = conn;
+    push(item);
+}
+
+ComputePool::Stats ComputePool::stats() const
+{
+    Stats stats;
+    stats.submitted = submitted_.load(std::memory_order_relaxed);
+    stats.completed = completed_.load(std::memory_order_relaxed);
+    stats.stolen = stolen_.load(std::memory_order_relaxed);
+    stats.throttled = throttled_.load(std::memory_order_relaxed);
+    stats.queued = queued_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void ComputePool::push(Job *job)
+{
+    ++submitted_;
+    int index = t_pool == this ? t_workerIndex : static_cast<int>(next_++ % numThreads_);
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        // 放进队列之前先计数，否则任务可能先被取走减掉queued_，无符号数下溢
+        // 先增加queued_再检查sleepers_，和工作线程等待前的检查顺序相反，不会丢失唤醒
+        // 同样先增加queued_再检查running_，工作线程退出前先检查running_再检查queued_，
+        // 看到running_的任务一定会被执行
+        ++queued_;
+        if (running_)
+        {
+            workers_[index]->jobs.push_back(job);
+            job = nullptr;
+        }
+        else
+        {
+            --queued_;
+        }
+    }
+    if (job != nullptr)
+    { // 还没有start或者已经stop，没有工作线程会取这个任务，直接在当前线程中执行
+        run(job);
+        return;
+    }
+    if (sleepers_.load() > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(idleMutex_);
+        }
+        idleCond_.notify_one();
+    }
+}
+
+// 先从自己的队尾取，再从其他线程的队头偷
+ComputePool::Job *ComputePool::take(int index)
+{
+    {
+        Worker &self = *workers_[index];
+        std::lock_guard<std::mutex> lock(self.mutex);
+        if (!self.jobs.empty())
+        {
+            Job *job = self.jobs.back();
+            self.jobs.pop_back();
+            --queued_;
+            return job;
+        }
+    }
+    for (int k = 1; k < numThreads_; ++k)
+    {
+        Worker &victim = *workers_[(index + k) % numThreads_];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty())
+        {
+            Job *job = victim.jobs.front();
+            victim.jobs.pop_front();
+            --queued_;
+            ++stolen_;
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void ComputePool::threadFunc(int index)
+{
+    t_pool = this;
+    t_workerIndex = index;
+    for (;;)
+    {
+        Job *job = take(index);
+        if (job != nullptr)
+        {
+            run(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idleMutex_);
+        ++sleepers_;
+        while (queued_.load() == 0 && running_)
+        {
+            idleCond_.wait(lock);
+        }
+        --sleepers_;
+        if (!running_ && queued_.load() == 0)
+        { // 停止之前提交的任务都已经执行完
+            break;
+        }
+    }
+    t_pool = nullptr;
+    t_workerIndex = -1;
+}
+
+void ComputePool::run(Job *job)
+{
+    job->work();
+    job->work.reset();
+    ++completed_;
+    if (job->loop != nullptr)
+    { // 投递回提交任务的loop，loop取走之前其他完成的任务不会再唤醒loop，相当于批量投递
+        job->loop->queueINLoop(std::bind(&ComputePool::complete, this, job));
+    }
+    else
+    {
+        delete job;
+    }
+}
+
+void ComputePool::complete(Job *job)
+{
+    std::unique_ptr<Job> guard(job);
+    if (job->conn)
+    {
+        const TcpConnectionPtr &conn = job->conn;
+        const int outstanding = conn->outstandingJobs() - 1;
+        conn->setOutstandingJobs(outstanding);
+        if (conn->computeThrottled() && outstanding <= maxOutstanding_ / 2)
+        { // 只恢复线程池自己停止的读，应用自己调用stopRead的连接不动
+            conn->setComputeThrottled(false);
+            if (conn->connected())
+            {
+                conn->startRead();
+            }
+        }
+    }
+    if (job->done)
+    {
+        job->done();
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "Callbacks.h"
+#include "Task.h"
+#include "Thread.h"
+#include "noncopyable.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class EventLoop;
+
+/**
+ * 计算线程池，把压缩、加解密、编码等耗时的处理从loop线程中拿出去执行
+ * 每个工作线程一个任务队列，自己从队尾取，队列空了从其他线程的队头偷任务
+ * 任务完成后的回调投递回提交任务的loop，由loop在下一轮循环中和其他回调一起批量执行
+ *
+ * 提交和某个连接相关的任务时带上连接：
+ * 连接上没有完成的任务超过上限时停止读这个连接，降到一半时再恢复，避免任务无限堆积
+ *
+ * 投递给loop的完成回调会访问线程池，线程池要比这些loop活得久
+ */
+class ComputePool : noncpoyable
+{
+public:
+    // 运行统计，任意线程都可以读取
+    struct Stats
+    {
+        uint64_t submitted; // 提交的任务个数
+        uint64_t completed; // 执行完的任务个数
+        uint64_t stolen;    // 从其他线程偷来执行的任务个数
+        uint64_t throttled; // 因为未完成的任务太多停止读连接的次数
+        size_t queued;      // 当前在队列中等待执行的任务个数
+    };
+
+    static const int KDefaultMaxOutstanding = 64;
+
+    explicit ComputePool(int numThreads, const std::string &name = std::string("compute"));
+    ~ComputePool();
+
+    void start();
+    // 等待已经提交的任务全部执行完再退出，完成回调照常投递给loop
+    // start之前或者stop之后提交的任务直接在提交的线程中执行
+    void stop();
+
+    // 在任意线程调用，job在工作线程中执行
+    void submit(Task job);
+    // 在loop线程中调用，job在工作线程中执行，完成后done在loop线程中执行
+    void submit(EventLoop *loop, Task job, Task done);
+    // 在conn所属的loop线程中调用，同上，并且按连接上未完成的任务个数做背压
+    void submit(const TcpConnectionPtr &conn, Task job, Task done);
+
+    // 每个连接最多未完成的任务个数，在start之前调用
+    void setMaxOutstandingPerConnection(int n) { maxOutstanding_ = n; }
+
+    int numThreads() const { return numThreads_; }
+    Stats stats() const;
+
+private:
+    struct Job
+    {
+        Task work;
+        Task done;
+        EventLoop *loop;
+        TcpConnectionPtr conn;
+    };
+
+    // 每个工作线程的任务队列，自己从队尾取，其他线程从队头偷
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Job *> jobs;
+        std::unique_ptr<Thread> thread;
+    };
+
+    void push(Job *job);
+    Job *take(int index);
+    void threadFunc(int index);
+    void run(Job *job);
+    // 在loop线程中执行任务的完成回调
+    void complete(Job *job);
+
+    const int numThreads_;
+    const std::string name_;
+    int maxOutstanding_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic_bool running_;
+    std::atomic<unsigned> next_; // 外部提交的任务轮流放到各个工作线程
+
+    // 没有任务时工作线程在这里等待
+    std::mutex idleMutex_;
+    std::condition_variable idleCond_;
+    std::atomic_int sleepers_;
+    std::atomic<size_t> queued_;
+
+    std::atomic<uint64_t> submitted_;
+    std::atomic<uint64_t> completed_;
+    std::atomic<uint64_t> stolen_;
+    std::atomic<uint64_t> throttled_;
+};
@@ -0,0 +1,264 @@
+#pragma once
+
+/**
+ * C++20协程的任务类型，只在用C++20编译的代码中可用，库本身仍然是C++11
+ * 用法：
+ *   CoTask<void> session(TcpConnectionPtr conn)
+ *   {
+ *       while (co_await conn->readAtLeast(4))
+ *       {
+ *           ...
+ *           conn->send(reply);
+ *           co_await conn->flush();
+ *       }
+ *   }
+ *   // 在连接建立的回调(loop线程)中启动
+ *   coSpawn(session(conn));
+ *
+ * 协程在co_await的地方挂起，由loop线程在事件到来时直接恢复(见Awaiter.h)
+ * 协程帧从当前线程的空闲链表中分配，一个loop一个线程，相当于每个loop一个内存池
+ */
+#if defined(__cpp_impl_coroutine)
+
+#include "noncopyable.h"
+
+#include <coroutine>
+#include <exception>
+#include <new>
+#include <stddef.h>
+#include <utility>
+
+// 协程帧的内存池，按KGranularity字节分成多个大小级别，每个线程一个
+class CoroutineFramePool : noncpoyable
+{
+public:
+    static void *allocate(size_t size)
+    {
+        const size_t index = sizeClass(size);
+        if (index < KNumClasses)
+        {
+            FreeNode *&head = local().heads[index];
+            if (head != nullptr)
+            {
+                FreeNode *node = head;
+                head = node->next;
+                return node;
+            }
+            return ::operator new((index + 1) * KGranularity);
+        }
+        return ::operator new(size);
+    }
+
+    // 在其他线程释放的帧挂到那个线程的链表上，内存都来自operator new，可以混用
+    static void deallocate(void *ptr, size_t size)
+    {
+        const size_t index = sizeClass(size);
+        if (index < KNumClasses)
+        {
+            FreeNode *node = static_cast<FreeNode *>(ptr);
+            FreeNode *&head = local().heads[index];
+            node->next = head;
+            head = node;
+            return;
+        }
+        ::operator delete(ptr);
+    }
+
+private:
+    static const size_t KGranularity = 64;
+    static const size_t KNumClasses = 32; // 超过2K的帧直接使用operator new
+
+    struct FreeNode
+    {
+        FreeNode *next;
+    };
+
+    struct FreeLists
+    {
+        FreeLists()
+        {
+            for (size_t i = 0; i < KNumClasses; ++i)
+            {
+                heads[i] = nullptr;
+            }
+        }
+        ~FreeLists()
+        {
+            for (size_t i = 0; i < KNumClasses; ++i)
+            {
+                while (heads[i] != nullptr)
+                {
+                    FreeNode *next = heads[i]->next;
+                    ::operator delete(heads[i]);
+                    heads[i] = next;
+                }
+            }
+        }
+        FreeNode *heads[KNumClasses];
+    };
+
+    static size_t sizeClass(size_t size) { return (size - 1) / KGranularity; }
+
+    static FreeLists &local()
+    {
+        static thread_local FreeLists lists;
+        return lists;
+    }
+};
+
+template <typename T>
+class CoTask;
+
+// CoTask的promise中和返回值无关的部分
+class CoPromiseBase
+{
+public:
+    CoPromiseBase() : detached_(false) {}
+
+    static void *operator new(size_t size) { return CoroutineFramePool::allocate(size); }
+    static void operator delete(void *ptr, size_t size) { CoroutineFramePool::deallocate(ptr, size); }
+
+    // 创建之后先不执行，被co_await或者coSpawn时才开始
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // 结束时直接切换到等待它的协程，不经过loop；分离的任务自己释放协程帧
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            CoPromiseBase &promise = handle.promise();
+            if (promise.detached_)
+            {
+                handle.destroy();
+                return std::noop_coroutine();
+            }
+            return promise.continuation_ ? promise.continuation_ : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception()
+    {
+        if (detached_)
+        { // 没有人能接收分离任务的异常
+            std::terminate();
+        }
+        exception_ = std::current_exception();
+    }
+
+    void setContinuation(std::coroutine_handle<> continuation) { continuation_ = continuation; }
+    void setDetached() { detached_ = true; }
+
+protected:
+    void rethrowIfFailed()
+    {
+        if (exception_)
+        {
+            std::rethrow_exception(exception_);
+        }
+    }
+
+private:
+    std::coroutine_handle<> continuation_;
+    std::exception_ptr exception_;
+    bool detached_;
+};
+
+// T需要可以默认构造
+template <typename T>
+class CoPromise : public CoPromiseBase
+{
+public:
+    CoTask<T> get_return_object();
+    void return_value(T value) { value_ = std::move(value); }
+    T result()
+    {
+        rethrowIfFailed();
+        return std::move(value_);
+    }
+
+private:
+    T value_;
+};
+
+template <>
+class CoPromise<void> : public CoPromiseBase
+{
+public:
+    CoTask<void> get_return_object();
+    void return_void() {}
+    void result() { rethrowIfFailed(); }
+};
+
+/**
+ * 协程任务，只能移动
+ * co_await一个CoTask时开始执行，结束后直接恢复等待它的协程
+ * 最外层的任务用coSpawn启动，结束后自己释放
+ */
+template <typename T = void>
+class CoTask : noncpoyable
+{
+public:
+    using promise_type = CoPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit CoTask(Handle handle) : handle_(handle) {}
+    CoTask(CoTask &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    CoTask &operator=(CoTask &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    ~CoTask() { reset(); }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+    {
+        handle_.promise().setContinuation(continuation);
+        return handle_;
+    }
+    T await_resume() { return handle_.promise().result(); }
+
+    // 交出协程帧的所有权，coSpawn使用
+    Handle release() { return std::exchange(handle_, nullptr); }
+
+private:
+    void reset()
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+            handle_ = nullptr;
+        }
+    }
+
+    Handle handle_;
+};
+
+template <typename T>
+CoTask<T> CoPromise<T>::get_return_object()
+{
+    return CoTask<T>(std::coroutine_handle<CoPromise<T>>::from_promise(*this));
+}
+
+inline CoTask<void> CoPromise<void>::get_return_object()
+{
+    return CoTask<void>(std::coroutine_handle<CoPromise<void>>::from_promise(*this));
+}
+
+// 在当前线程开始执行task，执行到第一次挂起时返回，任务结束后自己释放协程帧
+inline void coSpawn(CoTask<void> &&task)
+{
+    CoTask<void>::Handle handle = task.release();
+    handle.promise().setDetached();
+    handle.resume();
+}
+
+#endif // __cpp_impl_coroutine
@@ -1,20 +1,45 @@
 #include "Poller.h"
 #include "EPollPoller.h"
+#include "IoUringPoller.h"
+#include "Logger.h"
 #include <stdlib.h>
 
 Poller* Poller::newDefaultPoller(EventLoop *loop)
 {
     /**
      * 当环境变量中定义了MUDUO_USE_POLL时才使用poll IO复用
+     * 定义了MUDUO_USE_IOURING时使用io_uring
      * 否则默认使用epoll IO复用
      */
     if(::getenv("MUDUO_USE_POLL"))
     {
         return nullptr; // 返回poll的实例
     }
+    else if (::getenv("MUDUO_USE_IOURING"))
+    {
+        return newPoller(loop, KIoUringBackend);
+    }
     else
     {
         return new EPollPoller(loop); // 返回epoll的实例
     }
     
-}
\ No newline at end of file
+}
+
+Poller *Poller::newPoller(EventLoop *loop, Backend backend)
+{
+    switch (backend)
+    {
+    case KEpollBackend:
+        return new EPollPoller(loop);
+    case KIoUringBackend:
+        if (IoUringPoller::available())
+        {
+            return new IoUringPoller(loop);
+        }
+        LOG_ERROR("%s:%s:%d  io_uring is not available, fall back to epoll\n", __FILE__, __FUNCTION__, __LINE__);
+        return new EPollPoller(loop);
+    default:
+        return newDefaultPoller(loop);
+    }
+}
@@ -75,7 +75,7 @@ void EPollPoller::updateChannel(Channel *channel)
     // channel的index的值对应于channel在poller中的状态
     const int index = channel->index();
 
-    LOG_INFO("%s:%s:%d  fd = %d events = %d index = %d\n",
+    LOG_DEBUG("%s:%s:%d  fd = %d events = %d index = %d\n",
              __FILE__, __FUNCTION__, __LINE__,
              channel->fd(), channel->events(), index);
 
@@ -85,8 +85,8 @@ void EPollPoller::updateChannel(Channel *channel)
         if (index == KNew)
         { // index == KNew表示当前Channel不在Poller中
             int fd = channel->fd(); // 获取当前Channel的fd
-            // 将当前Channel添加到Poller中
-            channels_[fd] == channel;
+            // 将当前Channel添加到Poller中，得到新的注册编号
+            channels_.add(fd, channel);
         }
         // 将当前channel设置为KAdded表示已添加到channel
         channel->set_index(KAdded);
@@ -102,9 +102,9 @@ void EPollPoller::updateChannel(Channel *channel)
             update(EPOLL_CTL_DEL, channel); // 从内核事件表中删除
             channel->set_index(KDeleted);   // 将channel标记为已从当前poller中删除
         }
-        else
+        else if (channels_.events(fd) != channel->events())
         {
-            // 在内核事件表中更新channel对应fd关注的事件
+            // 在内核事件表中更新channel对应fd关注的事件，没有变化时不需要epoll_ctl
             update(EPOLL_CTL_MOD, channel);
         }
     }
@@ -114,7 +114,7 @@ void EPollPoller::removeChannel(Channel *channel)
 {
     // 从Poller中的map中删除fd以及对应的Channel
     int fd = channel->fd();
-    channels_.erase(fd);
+    channels_.remove(fd);
     LOG_INFO("%s:%s:%d  fd = %d\n", __FILE__, __FUNCTION__, __LINE__, fd);
 
     // 获取index查看当前channel是KAdded/KDeleted
@@ -134,7 +134,15 @@ void EPollPoller::fillActionChannels(int numEvents, ChannelList *activeChannels)
 {
     for (int i = 0; i < numEvents; ++i)
     {
-        Channel *channel = static_cast<Channel *>(events_[i].data.ptr);
+        // data的高32位是注册编号，低32位是fd
+        int fd = static_cast<int>(events_[i].data.u64 & 0xffffffff);
+        uint32_t generation = static_cast<uint32_t>(events_[i].data.u64 >> 32);
+        Channel *channel = channels_.find(fd, generation);
+        if (channel == nullptr)
+        { // fd已经被删除或者复用，丢弃旧的事件，这是正常情况
+            LOG_DEBUG("%s:%s:%d  stale event fd = %d\n", __FILE__, __FUNCTION__, __LINE__, fd);
+            continue;
+        }
         channel->set_revents(events_[i].events);
         activeChannels->push_back(channel);
     }
@@ -149,8 +157,11 @@ void EPollPoller::update(int operation, Channel *channel)
     int fd = channel->fd();
 
     event.events = channel->events();
-    event.data.fd = fd;
-    event.data.ptr = channel;
+    // 带上注册编号，fillActionChannels中用来识别旧的事件
+    event.data.u64 = (static_cast<uint64_t>(channels_.generation(fd)) << 32) | static_cast<uint32_t>(fd);
+
+    // 记录内核事件表中的事件
+    channels_.setEvents(fd, operation == EPOLL_CTL_DEL ? 0 : event.events);
 
     // 调用epoll_ctl
     if (::epoll_ctl(epollfd_, operation, fd, &event) < 0)
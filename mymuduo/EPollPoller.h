@@ -27,6 +27,9 @@ public:
 
     void removeChannel(Channel *channel) override;
 
+    bool supportsEdgeTriggered() const override { return true; }
+    bool supportsExclusiveWakeup() const override { return true; }
+
 private:
     // 初始化EventList大小
     static const int KInitEventListSize = 16;
@@ -1,9 +1,14 @@
 #include "EventLoop.h"
+#include "BufferPool.h"
 #include "Channel.h"
 #include "Logger.h"
 #include "Poller.h"
+#include "TimerQueue.h"
 
+#include <algorithm>
 #include <fcntl.h>
+#include <limits>
+#include <pthread.h>
 #include <memory>
 #include <sys/eventfd.h> // eventfd
 #include <unistd.h>
@@ -28,14 +33,28 @@ int createEventfd()
     return evtfd;
 }
 
-EventLoop::EventLoop()
+EventLoop::EventLoop(Poller::Backend backend)
     : looping_(false)
     , quit_(false)
     , callingPendingFunctors_(false)
+    , wakeupPending_(false)
+    , maxFunctorsPerIteration_(0)
+    , maxReadBytesPerIteration_(0)
+    , busyPollUs_(0)
+    , spinning_(false)
+    , spinDeadlineUs_(0)
+    , pendingSinceUs_(0)
+    , numConnections_(0)
+    , loadScore_(0)
+    , loadUpdatedNs_(EventLoopStats::nowNs())
+    , loadWindowStartNs_(loadUpdatedNs_.load())
+    , loadWindowBusyNs_(0)
     , threadId_(CurrentThread::tid())
-    , poller_(Poller::newDefaultPoller(this))
+    , poller_(Poller::newPoller(this, backend))
     , wakeupFd_(createEventfd())
     , wakeupChannel_(new Channel(this, wakeupFd_))
+    , timerQueue_(new TimerQueue(this))
+    , bufferPool_(std::make_shared<BufferPool>())
 {
     LOG_DEBUG("%s:%s:%d  EventLoop created %p in thread %d \n"
                 ,__FILE__,__FUNCTION__,__LINE__, this, threadId_);
@@ -54,6 +73,12 @@ EventLoop::EventLoop()
      * 从而保证了所有的EventLoop之间可以通过wakeupfd来相互通信
      * */
 
+    // EventLoop在所属的线程中创建，记下这个线程的CPU时钟
+    if (::pthread_getcpuclockid(::pthread_self(), &cpuClock_) != 0)
+    {
+        cpuClock_ = CLOCK_THREAD_CPUTIME_ID;
+    }
+
     // 设置wakeupfd发生事件时的回调函数
     wakeupChannel_->setReadCallback(std::bind(&EventLoop::handleRead, this));
     // 设置wakerpfd关注的事件类型(可读)
@@ -78,10 +103,16 @@ void EventLoop::loop()
 
     while (!quit_)
     {
+        const int64_t iterationStart = EventLoopStats::nowNs();
         // 清空存储就绪sockfd对应的Channel的数组
         activeChannels_.clear();
+        // 上一轮循环中修改的关注事件一次更新到poller中
+        flushChannelUpdates();
         // 底层就是调用epoll_wait,并返回就绪的sockfd,一般阻塞在这里的等待新的链接或者读写事件
-        pollReturnTime_ = poller_->Poll(KPollTimeMs, &activeChannels_);
+        const int64_t pollStart = EventLoopStats::nowNs();
+        pollReturnTime_ = poller_->Poll(pollTimeout(), &activeChannels_);
+        const int64_t pollEnd = EventLoopStats::nowNs();
+        activity_.beginIteration(stats_.iterations.load(std::memory_order_relaxed), pollEnd);
 
         for (Channel *channel : activeChannels_)
         {
@@ -89,11 +120,32 @@ void EventLoop::loop()
             // 就是调用发生事件的sockfd对应的回调函数(read/write/close)
             channel->handleEvent(pollReturnTime_);
         }
+        const int64_t eventsEnd = EventLoopStats::nowNs();
         /** 
          * 这里执行这个函数主要实在每次wakeup当前的loop
          * 时处理的，主要就是给subloop添加新的连接
          */
-        doPendingFunctors();
+        size_t numFunctors = doPendingFunctors();
+        // 批量处理其他loop通过环形队列送来的消息
+        size_t numMessages = doIterationCallbacks();
+        const int64_t functorsEnd = EventLoopStats::nowNs();
+
+        stats_.iterations.store(stats_.iterations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        stats_.pollNs.record(pollEnd - pollStart);
+        stats_.activeChannels.record(activeChannels_.size());
+        stats_.handleEventNs.record(eventsEnd - pollEnd);
+        stats_.functorsNs.record(functorsEnd - eventsEnd);
+        stats_.queueDepth.record(numFunctors);
+        stats_.busyNs.record((pollStart - iterationStart) + (functorsEnd - pollEnd));
+        updateLoad(functorsEnd, (pollStart - iterationStart) + (functorsEnd - pollEnd));
+        activity_.endIteration();
+
+        // 忙轮询模式下每次有工作都延长忙轮询的时间
+        const int spinUs = busyPollUs_.load(std::memory_order_relaxed);
+        if (spinUs > 0 && (!activeChannels_.empty() || numFunctors > 0 || numMessages > 0))
+        {
+            spinDeadlineUs_ = Timestamp::monotonicNow().microSecondsSinceEpoch() + spinUs;
+        }
     }
 
     LOG_INFO("%s:%s:%d  EventLoop %p stop looping\n"
@@ -105,26 +157,69 @@ void EventLoop::loop()
 // 这个函数其实主要就是调用mainloop给subloop注册的回调函数
 // 处理的就是给subloop分配新的连接
 // 或者是subloop调用回调关闭连接
-void EventLoop::doPendingFunctors()
+size_t EventLoop::doPendingFunctors()
 {
-    std::vector<Functor> functors;
     callingPendingFunctors_ = true;
 
+    // 先清掉wakeupPending_再取回调，之后入队的线程会重新唤醒loop
+    wakeupPending_.exchange(false);
+
+    // 记录跨线程回调从投递到开始执行的延迟
+    int64_t since = pendingSinceUs_.exchange(0);
+    if (since > 0)
     {
-        std::unique_lock<std::mutex> lock(mutex_);
-        // 使用局部的一个functors交换pendingFunctors，
-        // 这样可以解放pendingFunctors，
-        // 然后让等待pendingFunctors的其他线程获取到锁后继续使用pendingFunctors
-        functors.swap(pendingFunctors_);
+        int64_t latency = Timestamp::monotonicNow().microSecondsSinceEpoch() - since;
+        Histogram &histogram = spinning_ ? spinWakeupLatency_ : blockWakeupLatency_;
+        histogram.record(latency > 0 ? latency : 0);
     }
 
-    // 执行回调
-    for (const Functor &functor : functors)
-    {
+    // 一次取走队列中所有的回调并执行，执行期间新加入的回调留到下一轮
+    // 设置了每轮的限制时，超出的回调也留到下一轮
+    const size_t maxFunctors = maxFunctorsPerIteration_.load(std::memory_order_relaxed);
+    size_t count = pendingFunctors_.consume(maxFunctors > 0 ? maxFunctors : std::numeric_limits<size_t>::max(), [this](Functor &functor) {
+        LoopActivity::Scope scope(activity_, LoopActivity::KFunctorCallback, -1);
         functor();
-    }
+    });
 
     callingPendingFunctors_ = false;
+    return count;
+}
+
+size_t EventLoop::doIterationCallbacks()
+{
+    size_t count = 0;
+    for (const IterationCallback &cb : iterationCallbacks_)
+    {
+        count += cb();
+    }
+    return count;
+}
+
+void EventLoop::addIterationCallback(IterationCallback cb)
+{
+    runInLoop([this, cb] { iterationCallbacks_.push_back(cb); });
+}
+
+int EventLoop::pollTimeout()
+{
+    if (busyPollUs_.load(std::memory_order_relaxed) > 0 &&
+        Timestamp::monotonicNow().microSecondsSinceEpoch() < spinDeadlineUs_)
+    {
+        spinning_ = true;
+        return 0;
+    }
+    if (spinning_)
+    {
+        // 先清掉spinning_再检查队列：入队的线程要么看到spinning_为false去唤醒loop，
+        // 要么它的回调已经在队列中，这一轮不阻塞
+        spinning_ = false;
+    }
+    // 队列中还有回调(忙轮询期间投递的，或者上一轮超过限制留下的)，poll一次马上回来执行
+    if (!pendingFunctors_.empty())
+    {
+        return 0;
+    }
+    return KPollTimeMs;
 }
 
 /** 
@@ -152,26 +247,56 @@ void EventLoop::runInLoop(Functor cb)
     }
     else // 如果当前的loop就不属于当前线程，就唤醒loop所在线程
     {
-        queueINLoop(cb);
+        queueINLoop(std::move(cb));
     }
 }
 
 // 将回调放入队列中
 void EventLoop::queueINLoop(Functor cb)
 {
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb); // empace_back直接在底层构造一个 push_back是拷贝构造一个
+    const bool inLoopThread = isInLoopThread();
+    if (!inLoopThread && pendingSinceUs_.load(std::memory_order_relaxed) == 0)
+    { // 只记录最早一个还没执行的回调的投递时间
+        int64_t expected = 0;
+        pendingSinceUs_.compare_exchange_strong(expected, Timestamp::monotonicNow().microSecondsSinceEpoch());
     }
-    
+    pendingFunctors_.push(std::move(cb));
+
     // 唤醒相应需要执行上面cb回调的线程
     // || callingPendingFunctors_: 当前loop正在执行回调，但是此时又有新的回调加入，因此就需要再次唤醒loop，
-    if (!isInLoopThread() || callingPendingFunctors_)
+    // loop取走回调之前只有第一个入队的线程需要写wakeupFd_
+    // loop正在忙轮询时很快就会取走回调，不需要唤醒
+    if ((!inLoopThread || callingPendingFunctors_) && !spinning_ && !wakeupPending_.exchange(true))
     {
         wakeup(); // 唤醒loop所在线程
     }
 }
 
+// time是系统时间，换算成单调时钟的到期时间，之后修改系统时间不再影响这个定时器
+TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
+{
+    int64_t delay = time.microSecondsSinceEpoch() - Timestamp::now().microSecondsSinceEpoch();
+    Timestamp when(Timestamp::monotonicNow().microSecondsSinceEpoch() + delay);
+    return timerQueue_->addTimer(std::move(cb), when, 0.0);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::monotonicNow(), delay));
+    return timerQueue_->addTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::monotonicNow(), interval));
+    return timerQueue_->addTimer(std::move(cb), time, interval);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
 // 用来唤醒loop所在的线程,向wakeupFd_写一个数据，然后线程就会被唤醒 --> 对应的读就是handleRead
 void EventLoop::wakeup()
 {
@@ -198,13 +323,90 @@ void EventLoop::handleRead()
 
 void EventLoop::updateChannel(Channel *channel)
 {
-    poller_->updateChannel(channel);
+    // pendingUpdates_和channel的下标没有加锁，只能在loop线程中修改
+    assertInLoopThread();
+    if (!channel->updatePending())
+    { // 比如先enableWriting再disableWriting，只在poll之前按最终的事件更新一次
+        channel->setUpdateSlot(static_cast<int>(pendingUpdates_.size()));
+        pendingUpdates_.push_back(channel);
+    }
 }
 void EventLoop::removeChannel(Channel *channel)
 {
+    assertInLoopThread();
+    if (channel->updatePending())
+    { // 删除之后channel可能马上析构，不能再留在等待更新的列表中，按下标置空即可，flush时跳过
+        pendingUpdates_[channel->updateSlot()] = nullptr;
+        channel->setUpdateSlot(-1);
+    }
     poller_->removeChannel(channel);
 }
 bool EventLoop::hasChannel(Channel *channel)
 {
-    return poller_->hasChannel(channel);
+    return channel->updatePending() || poller_->hasChannel(channel);
+}
+bool EventLoop::edgeTriggeredSupported() const
+{
+    return poller_->supportsEdgeTriggered();
+}
+bool EventLoop::exclusiveWakeupSupported() const
+{
+    return poller_->supportsExclusiveWakeup();
+}
+
+int64_t EventLoop::threadCpuTimeUs() const
+{
+    timespec ts;
+    if (::clock_gettime(cpuClock_, &ts) != 0)
+    {
+        return 0;
+    }
+    return static_cast<int64_t>(ts.tv_sec) * Timestamp::KMicroSecondsPerSecond + ts.tv_nsec / 1000;
+}
+
+void EventLoop::updateLoad(int64_t nowNs, int64_t busyNs)
+{
+    loadWindowBusyNs_ += busyNs;
+    const int64_t elapsed = nowNs - loadWindowStartNs_;
+    if (elapsed < KLoadWindowMs * 1000 * 1000)
+    {
+        return;
+    }
+    // 和上一个窗口的值平均一下，避免一次突发把loop标记成很忙
+    const int current = static_cast<int>(std::min<int64_t>(loadWindowBusyNs_ * 1000 / elapsed, 1000));
+    loadScore_.store((loadScore_.load(std::memory_order_relaxed) + current) / 2, std::memory_order_relaxed);
+    loadUpdatedNs_.store(nowNs, std::memory_order_relaxed);
+    loadWindowStartNs_ = nowNs;
+    loadWindowBusyNs_ = 0;
+}
+
+int EventLoop::loadScore() const
+{
+    // 很久没有更新说明loop一直阻塞在poll中，是空闲的
+    // (一个回调卡住很久的loop也会被当成空闲的，这种情况交给StallWatchdog)
+    if (EventLoopStats::nowNs() - loadUpdatedNs_.load(std::memory_order_relaxed) > 10 * KLoadWindowMs * 1000 * 1000)
+    {
+        return 0;
+    }
+    return loadScore_.load(std::memory_order_relaxed);
+}
+
+void EventLoop::abortNotInLoopThread() const
+{
+    LOG_FATAL("%s:%s:%d  EventLoop %p was created in thread %d, current thread %d \n"
+                ,__FILE__,__FUNCTION__,__LINE__, this, threadId_, CurrentThread::tid());
+}
+
+void EventLoop::flushChannelUpdates()
+{
+    for (Channel *channel : pendingUpdates_)
+    {
+        if (channel == nullptr)
+        {
+            continue;
+        }
+        channel->setUpdateSlot(-1);
+        poller_->updateChannel(channel);
+    }
+    pendingUpdates_.clear();
 }
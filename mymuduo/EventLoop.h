@@ -1,25 +1,38 @@
 #pragma once
+#include "Awaiter.h"
+#include "Callbacks.h"
 #include "CurrentThread.h"
+#include "EventLoopStats.h"
+#include "Histogram.h"
+#include "LoopActivity.h"
+#include "MpscQueue.h"
+#include "Poller.h"
+#include "Task.h"
+#include "TimerId.h"
 #include "Timestamp.h"
 #include "noncopyable.h"
 
 #include <atomic>
 #include <functional>
 #include <memory>
-#include <mutex>
+#include <time.h>
 #include <unistd.h>
 #include <vector>
 
+class BufferPool;
 class Channel;
-class Poller;
+class TimerQueue;
 
 class EventLoop : noncpoyable
 {
 public:
-    // 回调函数类型
-    using Functor = std::function<void()>;
+    // 回调函数类型，只能移动，小的可调用对象不需要在堆上分配内存
+    using Functor = Task;
+    // 每轮循环调用一次的回调，返回这次处理的消息个数
+    using IterationCallback = std::function<size_t()>;
 
-    EventLoop();
+    // backend选择poller的IO复用实现，默认由环境变量决定
+    explicit EventLoop(Poller::Backend backend = Poller::KDefaultBackend);
     ~EventLoop();
 
     // 启动EventLoop
@@ -35,17 +48,99 @@ public:
     // 将回调放入队列中
     void queueINLoop(Functor cb);
 
+    // 在time时刻(系统时间)执行cb，可以在其他线程调用
+    TimerId runAt(Timestamp time, TimerCallback cb);
+    // delay秒之后执行cb
+    TimerId runAfter(double delay, TimerCallback cb);
+    // 每隔interval秒执行一次cb
+    TimerId runEvery(double interval, TimerCallback cb);
+    // 取消定时器
+    void cancel(TimerId timerId);
+    // 协程中co_await loop->sleep(ms)，ms毫秒之后在loop线程中恢复(见Awaiter.h)
+    SleepAwaiter sleep(int ms) { return SleepAwaiter(this, ms / 1000.0); }
+
+    // 每轮循环在执行完投递的回调之后调用cb，用来批量处理其他方式送到loop的消息(比如LoopMesh)
+    // 可以在任意线程调用，在loop线程中生效，不能删除
+    void addIterationCallback(IterationCallback cb);
+
     void wakeup();
+    // channel关注的事件改变了，同一轮循环中的多次修改合并成一次，在下一次poll之前更新到poller中
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
     bool hasChannel(Channel *channel);
+    // poller是否支持边沿触发
+    bool edgeTriggeredSupported() const;
+    // poller是否支持独占唤醒(EPOLLEXCLUSIVE)
+    bool exclusiveWakeupSupported() const;
+
+    // 忙轮询模式：有事件或者回调之后的spinUs微秒内用0超时poll，不阻塞在epoll_wait中，
+    // 一直没有新的事件才回到阻塞等待；忙轮询期间其他线程投递回调不需要写eventfd唤醒
+    // spinUs为0表示关闭，可以在任意线程调用
+    void setBusyPoll(int spinUs) { busyPollUs_ = spinUs; }
+    int busyPoll() const { return busyPollUs_; }
+
+    // 公平调度：每轮最多执行n个投递的回调，剩下的按顺序留到下一轮，并且下一轮poll不等待
+    // 避免大量跨线程回调推迟所有连接的IO，0表示不限制，可以在任意线程调用
+    void setMaxFunctorsPerIteration(size_t n) { maxFunctorsPerIteration_ = n; }
+    size_t maxFunctorsPerIteration() const { return maxFunctorsPerIteration_.load(std::memory_order_relaxed); }
+    // 每个连接每轮最多读取的字节数(每次读之后检查)，没读完的数据留到下一轮，0表示不限制
+    // 水平触发每轮只读一次，主要限制的是边沿触发连接一直读到EAGAIN的情况
+    void setMaxReadBytesPerIteration(size_t n) { maxReadBytesPerIteration_ = n; }
+    size_t maxReadBytesPerIteration() const { return maxReadBytesPerIteration_.load(std::memory_order_relaxed); }
+
+    // 其他线程投递回调到loop开始执行的延迟(微秒)，按忙轮询和阻塞等待两种情况分别统计
+    // 任意线程都可以读取
+    const Histogram &spinWakeupLatency() const { return spinWakeupLatency_; }
+    const Histogram &blockWakeupLatency() const { return blockWakeupLatency_; }
+
+    // 每轮循环的运行统计，任意线程都可以读取
+    const EventLoopStats &stats() const { return stats_; }
+    EventLoopStats &stats() { return stats_; }
+    // loop线程使用的CPU时间(微秒)，任意线程都可以调用
+    int64_t threadCpuTimeUs() const;
+
+    // 负载信息，EventLoopThreadPool按这些选择新连接的loop，任意线程都可以读取
+    // 分到这个loop上还没有关闭的连接个数，由TcpServer在分配和移除连接时修改
+    int numConnections() const { return numConnections_.load(std::memory_order_relaxed); }
+    void addConnections(int delta) { numConnections_.fetch_add(delta, std::memory_order_relaxed); }
+    // 最近一段时间loop不在poll中的时间比例(千分比)，每KLoadWindowMs毫秒更新一次
+    int loadScore() const;
+
+    // loop当前正在执行的回调，看门狗(StallWatchdog)用来检测卡住的loop
+    const LoopActivity &activity() const { return activity_; }
+    LoopActivity &activity() { return activity_; }
+
+    // 当前loop的数据块空闲链表，分段Buffer从这里取块
+    const std::shared_ptr<BufferPool> &bufferPool() const { return bufferPool_; }
 
     // 判断时候在当前进程中
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
+    // 不在loop所在线程时直接终止程序，只能在loop线程中调用的函数使用
+    void assertInLoopThread() const
+    {
+        if (!isInLoopThread())
+        {
+            abortNotInLoopThread();
+        }
+    }
+    // loop所在线程的tid
+    pid_t threadId() const { return threadId_; }
 
 private:
+    void abortNotInLoopThread() const;
     void handleRead(); // wakeup使用
-    void doPendingFunctors();
+    // 返回执行的回调个数
+    size_t doPendingFunctors();
+    // 返回处理的消息个数
+    size_t doIterationCallbacks();
+    // 这一轮poll的超时时间，忙轮询期间或者还有回调没有执行时为0
+    int pollTimeout();
+    // 把这一轮循环中修改过的channel更新到poller中
+    void flushChannelUpdates();
+    // 累计这一轮的繁忙时间，统计窗口结束时更新loadScore_
+    void updateLoad(int64_t nowNs, int64_t busyNs);
+
+    static const int64_t KLoadWindowMs = 100;
 
     using ChannelList = std::vector<Channel *>;
 
@@ -58,6 +153,10 @@ private:
     // 记录Poller返回就绪sockfd的事件
     Timestamp pollReturnTime_;
 
+    // 关注的事件有变化，等待更新到poller中的channel
+    // 放在poller_和timerQueue_之前，保证它们析构时仍然可以使用
+    ChannelList pendingUpdates_;
+
     // 当前的EventLoop的Poller
     std::unique_ptr<Poller> poller_;
 
@@ -67,13 +166,45 @@ private:
     // 封装线程通信的eventfd对应的Channel
     std::unique_ptr<Channel> wakeupChannel_;
 
+    // 当前loop的定时器队列(timerfd驱动)
+    std::unique_ptr<TimerQueue> timerQueue_;
+
     // EventLoop用户保存Poller返回就绪的sockfd对应的channel对象的
     ChannelList activeChannels_;
 
+    // 当前loop上所有分段Buffer共用的数据块空闲链表
+    std::shared_ptr<BufferPool> bufferPool_;
+
     // 这个主要控制当前loop是否正在执行回调
     std::atomic_bool callingPendingFunctors_;
-    // 保存当前loop需要执行的回调函数
-    std::vector<Functor> pendingFunctors_;
-    // 确保回调函数容器线程安全的锁
-    std::mutex mutex_;
+    // 保存当前loop需要执行的回调函数(无锁的多生产者单消费者队列)
+    MpscQueue<Functor> pendingFunctors_;
+    // 每轮循环调用的回调，只在loop线程中访问
+    std::vector<IterationCallback> iterationCallbacks_;
+    // 已经有线程写过wakeupFd_，loop还没有取走回调，其他线程不需要再写
+    std::atomic_bool wakeupPending_;
+
+    // 每轮最多执行的回调个数和每个连接最多读取的字节数，0表示不限制
+    std::atomic<size_t> maxFunctorsPerIteration_;
+    std::atomic<size_t> maxReadBytesPerIteration_;
+
+    // 忙轮询的时长(微秒)，0表示关闭
+    std::atomic_int busyPollUs_;
+    // loop正在忙轮询，投递回调不需要唤醒
+    std::atomic_bool spinning_;
+    // 忙轮询到这个时刻(微秒)为止
+    int64_t spinDeadlineUs_;
+    // 最早一个还没执行的跨线程回调的投递时间(微秒)，0表示没有
+    std::atomic<int64_t> pendingSinceUs_;
+    Histogram spinWakeupLatency_;
+    Histogram blockWakeupLatency_;
+
+    EventLoopStats stats_;
+    std::atomic_int numConnections_;
+    std::atomic_int loadScore_;
+    std::atomic<int64_t> loadUpdatedNs_; // loadScore_的更新时间
+    int64_t loadWindowStartNs_;
+    int64_t loadWindowBusyNs_;
+    clockid_t cpuClock_; // loop线程的CPU时钟
+    LoopActivity activity_;
 };
@@ -0,0 +1,45 @@
+#pragma once
+#include "Histogram.h"
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * EventLoop的运行统计，由loop线程在每轮循环中记录，任意线程都可以读取
+ * 时间都是纳秒，用单调时钟测量
+ * 比如 busyNs.sum() / (busyNs.sum() + pollNs.sum()) 就是loop的繁忙程度
+ */
+struct EventLoopStats : noncpoyable
+{
+    EventLoopStats() : iterations(0) {}
+
+    std::atomic<uint64_t> iterations; // 循环的轮数
+    Histogram pollNs;                 // 每轮阻塞在Poll中的时间
+    Histogram activeChannels;         // 每轮Poll返回的就绪channel个数
+    Histogram handleEventNs;          // 每轮执行channel回调(handleEvent)的时间
+    Histogram functorsNs;             // 每轮执行doPendingFunctors的时间
+    Histogram queueDepth;             // 每轮doPendingFunctors取出的回调个数
+    Histogram busyNs;                 // 每轮不在Poll中的时间
+
+    // 清空所有统计
+    void reset()
+    {
+        iterations.store(0, std::memory_order_relaxed);
+        pollNs.reset();
+        activeChannels.reset();
+        handleEventNs.reset();
+        functorsNs.reset();
+        queueDepth.reset();
+        busyNs.reset();
+    }
+
+    // 单调时钟的当前时间(纳秒)
+    static int64_t nowNs()
+    {
+        timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+    }
+};
@@ -1,13 +1,18 @@
 #include "EventLoopThread.h"
 #include "EventLoop.h"
+#include "Logger.h"
 
-EventLoopThread::EventLoopThread(const ThreadInitCallback &cb, const std::string &name)
+#include <pthread.h>
+#include <sched.h>
+
+EventLoopThread::EventLoopThread(const ThreadInitCallback &cb, const std::string &name, Poller::Backend backend)
     : loop_(nullptr)
     , exiting_(false)
     , thread_(std::bind(&EventLoopThread::threadFunc,this),name)
     , callback_(cb)
     , mutex_()
     ,cond_()
+    , backend_(backend)
 {
 
 }
@@ -41,11 +46,42 @@ EventLoop *EventLoopThread::startLoop()
     return loop;
 }
 
+std::vector<int> EventLoopThread::validCpus(const std::vector<int> &cpus)
+{
+    std::vector<int> valid;
+    for (int cpu : cpus)
+    {
+        if (cpu < 0 || cpu >= CPU_SETSIZE)
+        {
+            LOG_ERROR("%s:%s:%d  invalid cpu id %d ignored\n", __FILE__, __FUNCTION__, __LINE__, cpu);
+            continue;
+        }
+        valid.push_back(cpu);
+    }
+    return valid;
+}
+
 // 新线程调用的线程函数
 void EventLoopThread::threadFunc()
 {
+    if (!cpus_.empty())
+    { // 先绑定CPU再创建loop，poller、缓冲池等都在本地NUMA节点上分配
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus_)
+        {
+            CPU_SET(cpu, &set);
+        }
+        int err = ::pthread_setaffinity_np(::pthread_self(), sizeof set, &set);
+        if (err != 0)
+        {
+            LOG_ERROR("%s:%s:%d  pthread_setaffinity_np error : %d \n"
+                        , __FILE__, __FUNCTION__, __LINE__, err);
+        }
+    }
+
     // 启动新线程创建一个loop --> per thread one loop
-    EventLoop loop;
+    EventLoop loop(backend_);
     if(callback_)
     {
         callback_(&loop);
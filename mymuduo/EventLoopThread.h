@@ -1,9 +1,11 @@
 #pragma once
 #include "noncopyable.h"
+#include "Poller.h"
 #include "Thread.h"
 #include <functional>
 #include <mutex>
 #include <condition_variable>
+#include <vector>
 
 class EventLoop;
 
@@ -13,9 +15,18 @@ class EventLoopThread : noncpoyable
 public:
     using ThreadInitCallback = std::function<void(EventLoop*)>;
 
-    EventLoopThread(const ThreadInitCallback &cb = ThreadInitCallback(),const std::string &name = std::string());
+    EventLoopThread(const ThreadInitCallback &cb = ThreadInitCallback(),const std::string &name = std::string(),
+                    Poller::Backend backend = Poller::KDefaultBackend);
     ~EventLoopThread();
 
+    // 把线程绑定到cpus中的CPU上，在startLoop之前调用
+    // 绑定之后才创建EventLoop，loop的内存按首次访问分配在这些CPU所在的NUMA节点上
+    // 不在[0, CPU_SETSIZE)范围内的CPU编号打印日志后忽略
+    void setCpuAffinity(const std::vector<int> &cpus) { cpus_ = validCpus(cpus); }
+
+    // 去掉cpus中不合法的CPU编号
+    static std::vector<int> validCpus(const std::vector<int> &cpus);
+
     EventLoop *startLoop();
 private:
     void threadFunc();
@@ -27,5 +38,7 @@ private:
     std::condition_variable cond_;
 
     ThreadInitCallback callback_;
+    Poller::Backend backend_; // 新线程中EventLoop使用的IO复用实现
+    std::vector<int> cpus_;   // 绑定的CPU，为空表示不绑定
 };
 
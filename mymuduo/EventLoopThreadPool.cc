@@ -1,27 +1,99 @@
 #include "EventLoopThreadPool.h"
+#include "EventLoop.h"
 #include "EventLoopThread.h"
+#include "InetAddress.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sysinfo.h>
+
+// 把输入的各个位充分打散的32位哈希(murmur3的最后一步)，对不同的输入不会冲突
+static uint32_t mix32(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseloop, const std::string &nameArg)
-    : baseLoop_(baseloop), name_(nameArg), started_(false), numThreads_(0), next_(0)
+    : baseLoop_(baseloop), name_(nameArg), started_(false), numThreads_(0), next_(0), backend_(Poller::KDefaultBackend)
+    , policy_(KRoundRobin), random_(0x9e3779b9)
 {
 }
 EventLoopThreadPool::~EventLoopThreadPool()
 {
 }
 
+void EventLoopThreadPool::setCpuAffinity(const std::vector<std::vector<int>> &cpuSets)
+{
+    cpuSets_.clear();
+    for (const std::vector<int> &cpus : cpuSets)
+    {
+        cpuSets_.push_back(EventLoopThread::validCpus(cpus));
+    }
+}
+
 void EventLoopThreadPool::start(const ThreadInitCallback &cb)
 {
     started_ = true;
+    if (!cpuSets_.empty())
+    {
+        const int numCpus = ::get_nprocs_conf();
+        for (int cpu = 0; cpu < numCpus; ++cpu)
+        {
+            cpuNodes_.push_back(numaNodeOfCpu(cpu));
+        }
+    }
     // 创建EventLoop线程
     for (int i = 0; i < numThreads_; ++i)
     {
         char buf[name_.size() + 32] = {0};
         snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
-        EventLoopThread *t = new EventLoopThread(cb, buf);
+        EventLoopThread *t = new EventLoopThread(cb, buf, backend_);
+        int node = -1;
+        if (!cpuSets_.empty())
+        {
+            const std::vector<int> &cpus = cpuSets_[i % cpuSets_.size()];
+            t->setCpuAffinity(cpus);
+            for (int cpu : cpus)
+            {
+                if (cpu >= static_cast<int>(cpuToLoop_.size()))
+                {
+                    cpuToLoop_.resize(cpu + 1, -1);
+                }
+                if (cpuToLoop_[cpu] < 0)
+                {
+                    cpuToLoop_[cpu] = i;
+                }
+            }
+            if (!cpus.empty() && cpus.front() < static_cast<int>(cpuNodes_.size()))
+            {
+                node = cpuNodes_[cpus.front()];
+            }
+        }
+        loopNodes_.push_back(node);
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         loops_.push_back(t->startLoop());
     }
 
+    if (policy_ == KConsistentHash)
+    { // 每个loop在环上放KVirtualNodes个点，loop之间分到的客户端比较均匀
+        for (int i = 0; i < static_cast<int>(loops_.size()); ++i)
+        {
+            for (int v = 0; v < KVirtualNodes; ++v)
+            {
+                hashRing_.push_back(std::make_pair(mix32(static_cast<uint32_t>(i * KVirtualNodes + v) ^ 0x5bd1e995), i));
+            }
+        }
+        std::sort(hashRing_.begin(), hashRing_.end());
+    }
+
     // 单线程的服务端，baseloop
     if (numThreads_ == 0 && cb)
     {
@@ -46,6 +118,165 @@ EventLoop *EventLoopThreadPool::getNextLoop()
     return loop;
 }
 
+EventLoop *EventLoopThreadPool::getLoopForPeer(const InetAddress &peerAddr)
+{
+    if (loops_.size() <= 1)
+    {
+        return getNextLoop();
+    }
+    int index = -1;
+    switch (policy_)
+    {
+    case KLeastConnections:
+        index = leastConnections();
+        break;
+    case KLeastBusy:
+        index = leastBusy();
+        break;
+    case KPowerOfTwoChoices:
+        index = powerOfTwoChoices();
+        break;
+    case KConsistentHash:
+        index = consistentHash(peerAddr);
+        break;
+    default:
+        break;
+    }
+    return index >= 0 ? loops_[index] : getNextLoop();
+}
+
+bool EventLoopThreadPool::lessLoaded(int a, int b) const
+{
+    const int connsA = loops_[a]->numConnections();
+    const int connsB = loops_[b]->numConnections();
+    if (connsA != connsB)
+    {
+        return connsA < connsB;
+    }
+    return loops_[a]->loadScore() < loops_[b]->loadScore();
+}
+
+// 从next_开始找，负载相同的loop之间轮流分配
+int EventLoopThreadPool::leastConnections()
+{
+    const int n = static_cast<int>(loops_.size());
+    int best = next_ % n;
+    for (int k = 1; k < n; ++k)
+    {
+        const int index = (next_ + k) % n;
+        if (lessLoaded(index, best))
+        {
+            best = index;
+        }
+    }
+    next_ = (best + 1) % n;
+    return best;
+}
+
+int EventLoopThreadPool::leastBusy()
+{
+    const int n = static_cast<int>(loops_.size());
+    int best = next_ % n;
+    int bestScore = loops_[best]->loadScore();
+    for (int k = 1; k < n; ++k)
+    {
+        const int index = (next_ + k) % n;
+        const int score = loops_[index]->loadScore();
+        if (score < bestScore || (score == bestScore && loops_[index]->numConnections() < loops_[best]->numConnections()))
+        {
+            best = index;
+            bestScore = score;
+        }
+    }
+    next_ = (best + 1) % n;
+    return best;
+}
+
+int EventLoopThreadPool::powerOfTwoChoices()
+{
+    const uint32_t n = static_cast<uint32_t>(loops_.size());
+    const int a = static_cast<int>(nextRandom() % n);
+    int b = static_cast<int>(nextRandom() % (n - 1));
+    if (b >= a)
+    { // 保证两个loop不同
+        ++b;
+    }
+    return lessLoaded(b, a) ? b : a;
+}
+
+// 只用IP不用端口，同一个客户端的多个连接落在同一个loop上，可以共享loop内的缓存
+int EventLoopThreadPool::consistentHash(const InetAddress &peerAddr) const
+{
+    if (hashRing_.empty())
+    {
+        return -1;
+    }
+    const uint32_t hash = mix32(peerAddr.getsockaddr()->sin_addr.s_addr);
+    std::vector<std::pair<uint32_t, int>>::const_iterator it =
+        std::lower_bound(hashRing_.begin(), hashRing_.end(), std::make_pair(hash, 0));
+    if (it == hashRing_.end())
+    { // 环绕回第一个节点
+        it = hashRing_.begin();
+    }
+    return it->second;
+}
+
+uint32_t EventLoopThreadPool::nextRandom()
+{
+    random_ ^= random_ << 13;
+    random_ ^= random_ >> 17;
+    random_ ^= random_ << 5;
+    return random_;
+}
+
+EventLoop *EventLoopThreadPool::getLoopForCpu(int cpu)
+{
+    if (loops_.empty() || cpu < 0)
+    {
+        return getNextLoop();
+    }
+    if (cpu < static_cast<int>(cpuToLoop_.size()) && cpuToLoop_[cpu] >= 0)
+    { // 绑定在这个CPU上的loop
+        return loops_[cpuToLoop_[cpu]];
+    }
+    // 同一个NUMA节点上的loop，从next_开始找，节点内也是轮询
+    const int node = cpu < static_cast<int>(cpuNodes_.size()) ? cpuNodes_[cpu] : -1;
+    const int n = static_cast<int>(loops_.size());
+    for (int k = 0; node >= 0 && k < n; ++k)
+    {
+        const int index = (next_ + k) % n;
+        if (loopNodes_[index] == node)
+        {
+            next_ = (index + 1) % n;
+            return loops_[index];
+        }
+    }
+    return getNextLoop();
+}
+
+// /sys/devices/system/cpu/cpuN/目录下有一个nodeM的链接
+int EventLoopThreadPool::numaNodeOfCpu(int cpu)
+{
+    char path[64];
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = ::opendir(path);
+    if (dir == nullptr)
+    {
+        return 0;
+    }
+    int node = 0;
+    while (dirent *entry = ::readdir(dir))
+    {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+        {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    ::closedir(dir);
+    return node;
+}
+
 std::vector<EventLoop *> EventLoopThreadPool::getAllLoops()
 {
     if (loops_.empty())
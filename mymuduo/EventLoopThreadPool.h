@@ -1,13 +1,17 @@
 #pragma once
+#include "Poller.h"
 #include "noncopyable.h"
 
+#include <stdint.h>
 #include <string>
+#include <utility>
 #include <vector>
 #include <memory>
 #include <functional>
 
 class EventLoop;
 class EventLoopThread;
+class InetAddress;
 
 class EventLoopThreadPool : noncpoyable
 {
@@ -15,13 +19,41 @@ class EventLoopThreadPool : noncpoyable
 public:
     using ThreadInitCallback = std::function<void(EventLoop*)>;
 
+    // 新连接选择subloop的策略，负载信息见EventLoop::numConnections/loadScore
+    enum DispatchPolicy
+    {
+        KRoundRobin,        // 轮询
+        KLeastConnections,  // 连接数最少的loop
+        KLeastBusy,         // 最近繁忙程度最低的loop，相同时选连接数少的
+        KPowerOfTwoChoices, // 随机选两个loop，取连接数少的那个，不需要遍历所有loop
+        KConsistentHash,    // 按对端IP一致性哈希，同一个客户端的连接总是分到同一个loop上
+    };
+
     EventLoopThreadPool(EventLoop *baseloop,const std::string &nameArg);
     ~EventLoopThreadPool();
 
     void setThreadNum(int numThreads){ numThreads_ = numThreads;}
+    // 设置subloop使用的IO复用实现，在start之前调用
+    void setPollerBackend(Poller::Backend backend) { backend_ = backend; }
+    // 第i个subloop绑定到cpuSets[i % cpuSets.size()]中的CPU上，不合法的CPU编号被忽略，在start之前调用
+    void setCpuAffinity(const std::vector<std::vector<int>> &cpuSets);
+    // 设置getLoopForPeer使用的策略，在start之前调用
+    void setDispatchPolicy(DispatchPolicy policy) { policy_ = policy; }
+    DispatchPolicy dispatchPolicy() const { return policy_; }
     void start(const ThreadInitCallback&cb = ThreadInitCallback());
 
     EventLoop*getNextLoop();
+    // 按设置的策略给来自peerAddr的新连接选择subloop，只在baseloop中调用
+    EventLoop *getLoopForPeer(const InetAddress &peerAddr);
+    // 优先选择绑定在cpu上的subloop，其次是同一个NUMA节点上的subloop，都没有时轮询
+    // cpu一般是新连接的SO_INCOMING_CPU，小于0时直接轮询
+    EventLoop *getLoopForCpu(int cpu);
+
+    // 下标为CPU，值为绑定在这个CPU上的subloop下标，-1表示没有，start之后可用
+    const std::vector<int> &cpuToLoop() const { return cpuToLoop_; }
+
+    // cpu所在的NUMA节点，不知道时返回0
+    static int numaNodeOfCpu(int cpu);
 
     std::vector<EventLoop*> getAllLoops();
 
@@ -32,13 +64,34 @@ public:
         return name_;
     }
 private:
+    // 各个策略选出的loop下标
+    int leastConnections();
+    int leastBusy();
+    int powerOfTwoChoices();
+    int consistentHash(const InetAddress &peerAddr) const;
+    // 按连接数比较负载，相同时比较繁忙程度
+    bool lessLoaded(int a, int b) const;
+    uint32_t nextRandom();
+
+    static const int KVirtualNodes = 64; // 一致性哈希中每个loop在环上的虚拟节点个数
+
     EventLoop *baseLoop_;
     std::string name_;
     bool started_;
     int numThreads_;
     int next_;
+    Poller::Backend backend_;
     
     std::vector<std::unique_ptr<EventLoopThread>> threads_;
     std::vector<EventLoop*> loops_;
 
+    std::vector<std::vector<int>> cpuSets_;
+    std::vector<int> cpuToLoop_; // 下标为CPU，值为绑定在这个CPU上的subloop下标，-1表示没有
+    std::vector<int> loopNodes_; // 每个subloop所在的NUMA节点，没有绑定为-1
+    std::vector<int> cpuNodes_;  // 每个CPU所在的NUMA节点，start时读取一次
+
+    DispatchPolicy policy_;
+    uint32_t random_; // 随机选择使用的xorshift状态
+    std::vector<std::pair<uint32_t, int>> hashRing_; // 按哈希值排序的(虚拟节点的哈希值, loop下标)
+
 };
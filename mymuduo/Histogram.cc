@@ -0,0 +1,64 @@
+#include "Histogram.h"
+
+#include <math.h>
+
+Histogram::Histogram()
+{
+    reset();
+}
+
+double Histogram::mean() const
+{
+    uint64_t n = count();
+    return n > 0 ? static_cast<double>(sum()) / n : 0.0;
+}
+
+uint64_t Histogram::percentile(double p) const
+{
+    uint64_t n = count();
+    if (n == 0)
+    {
+        return 0;
+    }
+    // 第target个数据所在的桶
+    uint64_t target = static_cast<uint64_t>(ceil(p / 100.0 * n));
+    if (target == 0)
+    {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < KNumBuckets; ++i)
+    {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= target)
+        {
+            uint64_t upper = bucketUpperBound(i);
+            return upper < max() ? upper : max();
+        }
+    }
+    return max();
+}
+
+void Histogram::reset()
+{
+    for (int i = 0; i < KNumBuckets; ++i)
+    {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+// 桶中最大的值
+uint64_t Histogram::bucketUpperBound(int index)
+{
+    if (index < KSubBuckets)
+    {
+        return index;
+    }
+    int shift = index / KSubBuckets - 1;
+    uint64_t sub = index % KSubBuckets;
+    uint64_t lower = (KSubBuckets + sub) << shift;
+    return lower + (static_cast<uint64_t>(1) << shift) - 1;
+}
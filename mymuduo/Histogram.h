@@ -0,0 +1,65 @@
+#pragma once
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * 对数线性的直方图，用来统计延迟、个数等数据的分布
+ * 小于KSubBuckets的值每个值一个桶，更大的值每个2的幂区间再平均分成KSubBuckets个桶，
+ * 相对误差不超过1/KSubBuckets，桶的个数固定，记录数据不需要分配内存
+ * 只能由一个线程(所属loop的线程)记录，任意线程都可以读取
+ */
+class Histogram : noncpoyable
+{
+public:
+    Histogram();
+
+    // 记录一个数据，只在写的线程中调用
+    void record(uint64_t value)
+    {
+        std::atomic<uint64_t> &bucket = buckets_[bucketIndex(value)];
+        // 只有一个线程写，读改写不需要原子操作，relaxed保证其他线程读到的是完整的值
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        if (value > max_.load(std::memory_order_relaxed))
+        {
+            max_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    double mean() const;
+
+    // p为0到100之间的百分比，返回分位数所在桶的上界(不超过max())
+    uint64_t percentile(double p) const;
+
+    // 清空统计，和写的线程同时进行时个别数据可能统计不准
+    void reset();
+
+private:
+    static const int KSubBits = 3;
+    static const int KSubBuckets = 1 << KSubBits;
+    // 64位数据最高位在第KSubBits到63位时各有KSubBuckets个桶，再加上小于KSubBuckets的值
+    static const int KNumBuckets = (64 - KSubBits + 1) * KSubBuckets;
+
+    static int bucketIndex(uint64_t value)
+    {
+        if (value < static_cast<uint64_t>(KSubBuckets))
+        {
+            return static_cast<int>(value);
+        }
+        int shift = 63 - __builtin_clzll(value) - KSubBits;
+        int sub = static_cast<int>((value >> shift) & (KSubBuckets - 1));
+        return (shift + 1) * KSubBuckets + sub;
+    }
+    static uint64_t bucketUpperBound(int index);
+
+    std::atomic<uint64_t> buckets_[KNumBuckets];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
@@ -0,0 +1,392 @@
+#include "IoUringPoller.h"
+#include "Channel.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+const int KNew = -1;    // Channel未添加到Poller中
+const int KAdded = 1;   // Channel已添加到Poller中
+const int KDeleted = 2; // Channel从Poller删除
+
+// poll请求的user_data高32位是编号(从1开始)，低32位是fd，小于2^32的值留给取消请求和超时请求
+const uint64_t KCancelTag = 1;
+const uint64_t KFirstTimeoutTag = 2; // 超时请求从2开始编号
+const uint64_t KPollTagBase = static_cast<uint64_t>(1) << 32;
+
+// poll请求可以关注的事件，和epoll的取值相同
+const int KPollMask = EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLRDHUP | EPOLLERR | EPOLLHUP;
+
+// 没有使用liburing，直接调用系统调用
+static int sysIoUringSetup(unsigned entries, io_uring_params *params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int sysIoUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+bool IoUringPoller::available()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof params);
+    int fd = sysIoUringSetup(4, &params);
+    if (fd < 0)
+    {
+        return false;
+    }
+    ::close(fd);
+    // 需要内核保证完成事件不会丢失
+    return (params.features & IORING_FEAT_NODROP) != 0;
+}
+
+IoUringPoller::IoUringPoller(EventLoop *loop)
+    : Poller(loop)
+    , ringFd_(-1)
+    , sqRing_(nullptr)
+    , sqRingSize_(0)
+    , sqes_(nullptr)
+    , sqesSize_(0)
+    , sqLocalTail_(0)
+    , toSubmit_(0)
+    , cqRing_(nullptr)
+    , cqRingSize_(0)
+    , nextGeneration_(0)
+    , timeoutArmed_(false)
+    , armedTimeoutMs_(-1)
+    , timeoutUserData_(KFirstTimeoutTag)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof params);
+    ringFd_ = sysIoUringSetup(KRingEntries, &params);
+    if (ringFd_ < 0)
+    {
+        LOG_FATAL("%s:%s:%d io_uring_setup error : %d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+    { // 提交队列和完成队列可以用一次mmap映射
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+    {
+        LOG_FATAL("%s:%s:%d mmap sq ring error : %d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    if (singleMmap)
+    {
+        cqRing_ = sqRing_;
+    }
+    else
+    {
+        cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED)
+        {
+            LOG_FATAL("%s:%s:%d mmap cq ring error : %d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+        }
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        LOG_FATAL("%s:%s:%d mmap sqes error : %d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+    char *sq = static_cast<char *>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqEntries_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqLocalTail_ = *sqTail_;
+
+    char *cq = static_cast<char *>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+
+IoUringPoller::~IoUringPoller()
+{
+    ::munmap(sqes_, sqesSize_);
+    if (cqRing_ != sqRing_)
+    {
+        ::munmap(cqRing_, cqRingSize_);
+    }
+    ::munmap(sqRing_, sqRingSize_);
+    ::close(ringFd_);
+}
+
+// 提交所有请求并等待至少一个完成事件 -> 相当于epoll_wait
+Timestamp IoUringPoller::Poll(int timeoutMs, ChannelList *activeChannels)
+{
+    LOG_INFO("%s:%s:%d  IoUringPoller::Poll  fd total count %lu\n"
+            , __FILE__, __FUNCTION__, __LINE__, channels_.size());
+
+    // 上一次完成的poll请求重新提交，fd仍然就绪的话会马上完成(水平触发)
+    for (int fd : rearm_)
+    {
+        PollState &state = polls_[fd];
+        if (state.channel != nullptr && !state.armed && state.channel->events() != 0)
+        {
+            arm(fd, state, state.channel->events());
+        }
+    }
+    rearm_.clear();
+
+    int ret = 0;
+    if (timeoutMs == 0)
+    { // 不等待(忙轮询、还有回调没执行)：只提交请求，取走已经完成的事件
+        if (toSubmit_ > 0)
+        {
+            ret = enter(0, 0);
+        }
+    }
+    else
+    {
+        // 超时请求在有一个其他完成事件或者超时后完成
+        // 上一次等待被信号打断等情况下旧的超时请求还在，时长不同时换成新的
+        if (timeoutArmed_ && armedTimeoutMs_ != timeoutMs)
+        {
+            removeTimeout();
+        }
+        if (timeoutMs > 0 && !timeoutArmed_)
+        {
+            armTimeout(timeoutMs);
+        }
+        ret = enter(1, IORING_ENTER_GETEVENTS);
+    }
+    int savedErrno = errno;
+    Timestamp now(Timestamp::now());
+
+    size_t numEvents = activeChannels->size();
+    reapCompletions(activeChannels);
+    numEvents = activeChannels->size() - numEvents;
+
+    if (numEvents > 0)
+    {
+        LOG_INFO("%s:%s:%d    %lu events happend\n", __FILE__, __FUNCTION__, __LINE__, numEvents);
+    }
+    else if (ret >= 0 || savedErrno == EINTR)
+    {
+        LOG_INFO("%s:%s:%d   nothing events happend timeout!\n"
+                    , __FILE__, __FUNCTION__, __LINE__);
+    }
+    else
+    {
+        errno = savedErrno;
+        LOG_ERROR("%s:%s:%d   IoUringPoller::poll error : %d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return now;
+}
+
+void IoUringPoller::updateChannel(Channel *channel)
+{
+    const int index = channel->index();
+    const int fd = channel->fd();
+
+    LOG_INFO("%s:%s:%d  fd = %d events = %d index = %d\n",
+             __FILE__, __FUNCTION__, __LINE__,
+             fd, channel->events(), index);
+
+    if (index == KNew || index == KDeleted)
+    {
+        if (index == KNew)
+        {
+            channels_.add(fd, channel);
+            if (static_cast<size_t>(fd) >= polls_.size())
+            {
+                polls_.resize(std::max(static_cast<size_t>(fd) + 1, polls_.size() * 2));
+            }
+        }
+        channel->set_index(KAdded);
+
+        PollState &state = polls_[fd];
+        state.channel = channel;
+        state.armed = false;
+        arm(fd, state, channel->events());
+    }
+    else
+    {
+        PollState &state = polls_[fd];
+        if (channel->isNoneEvent())
+        {
+            cancel(state, fd);
+            channel->set_index(KDeleted);
+        }
+        else if (!state.armed)
+        { // poll请求已经完成还没有重新提交，直接用新的事件提交
+            arm(fd, state, channel->events());
+        }
+        else if (state.armedEvents != channel->events())
+        { // 关注的事件变了，取消旧的请求再提交新的
+            cancel(state, fd);
+            arm(fd, state, channel->events());
+        }
+    }
+}
+
+void IoUringPoller::removeChannel(Channel *channel)
+{
+    int fd = channel->fd();
+    channels_.remove(fd);
+    LOG_INFO("%s:%s:%d  fd = %d\n", __FILE__, __FUNCTION__, __LINE__, fd);
+
+    if (static_cast<size_t>(fd) < polls_.size())
+    {
+        PollState &state = polls_[fd];
+        cancel(state, fd);
+        state.channel = nullptr;
+    }
+    channel->set_index(KNew);
+}
+
+io_uring_sqe *IoUringPoller::getSqe()
+{
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqLocalTail_ - head >= sqEntries_)
+    { // 提交队列满了，先交给内核
+        enter(0, 0);
+    }
+    unsigned index = sqLocalTail_ & sqMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof *sqe);
+    sqArray_[index] = index;
+    ++sqLocalTail_;
+    ++toSubmit_;
+    return sqe;
+}
+
+int IoUringPoller::enter(unsigned minComplete, unsigned flags)
+{
+    __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+    int ret = sysIoUringEnter(ringFd_, toSubmit_, minComplete, flags);
+    if (ret >= 0)
+    { // 没有使用SQPOLL，返回时内核已经取走了这些请求
+        toSubmit_ = 0;
+    }
+    else if (errno != EINTR)
+    {
+        LOG_ERROR("%s:%s:%d  io_uring_enter error : %d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return ret;
+}
+
+void IoUringPoller::arm(int fd, PollState &state, int events)
+{
+    if ((events & KPollMask) == 0)
+    {
+        return;
+    }
+    if (++nextGeneration_ == 0)
+    { // 编号为0的user_data会和取消请求、超时请求混淆
+        nextGeneration_ = 1;
+    }
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events & KPollMask;
+    sqe->user_data = (static_cast<uint64_t>(nextGeneration_) << 32) | static_cast<uint32_t>(fd);
+
+    state.generation = nextGeneration_;
+    state.armedEvents = events;
+    state.armed = true;
+}
+
+void IoUringPoller::cancel(PollState &state, int fd)
+{
+    if (!state.armed)
+    {
+        return;
+    }
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = (static_cast<uint64_t>(state.generation) << 32) | static_cast<uint32_t>(fd);
+    sqe->user_data = KCancelTag;
+    state.armed = false;
+}
+
+void IoUringPoller::armTimeout(int timeoutMs)
+{
+    if (++timeoutUserData_ >= KPollTagBase)
+    {
+        timeoutUserData_ = KFirstTimeoutTag;
+    }
+    // 内核在提交时复制超时时长，timeout_可以重复使用
+    timeout_.tv_sec = timeoutMs / 1000;
+    timeout_.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(&timeout_);
+    sqe->len = 1;
+    sqe->off = 1;
+    sqe->user_data = timeoutUserData_;
+    timeoutArmed_ = true;
+    armedTimeoutMs_ = timeoutMs;
+}
+
+void IoUringPoller::removeTimeout()
+{
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = timeoutUserData_;
+    sqe->user_data = KCancelTag;
+    timeoutArmed_ = false;
+}
+
+// 填写活跃的连接，被取消的poll请求的完成事件直接丢弃
+void IoUringPoller::reapCompletions(ChannelList *activeChannels)
+{
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+        const io_uring_cqe &cqe = cqes_[head & cqMask_];
+        if (cqe.user_data == KCancelTag)
+        {
+            continue;
+        }
+        if (cqe.user_data < KPollTagBase)
+        { // 超时请求完成，已经被替换掉的旧请求不影响当前的请求
+            if (cqe.user_data == timeoutUserData_)
+            {
+                timeoutArmed_ = false;
+            }
+            continue;
+        }
+
+        int fd = static_cast<int>(cqe.user_data & 0xffffffff);
+        uint32_t generation = static_cast<uint32_t>(cqe.user_data >> 32);
+        if (static_cast<size_t>(fd) >= polls_.size())
+        {
+            continue;
+        }
+        PollState &state = polls_[fd];
+        if (state.channel == nullptr || state.generation != generation || !state.armed)
+        { // 已经取消或者替换掉的旧请求
+            continue;
+        }
+        state.armed = false;
+        // 出错时按照epoll的EPOLLERR处理
+        state.channel->set_revents(cqe.res >= 0 ? cqe.res : static_cast<int>(EPOLLERR));
+        activeChannels->push_back(state.channel);
+        rearm_.push_back(fd);
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "Poller.h"
+#include "Timestamp.h"
+
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * 派生类IoUringPoller->用io_uring的poll请求实现Poller
+ * io_uring_setup   创建环形队列
+ * IORING_OP_POLL_ADD / IORING_OP_POLL_REMOVE 相当于epoll_ctl add/del
+ * io_uring_enter   提交请求并等待完成事件，相当于epoll_wait
+ *
+ * poll请求是一次性的，完成之后在下一次Poll时重新提交，得到和epoll一样的水平触发语义
+ * 一次循环中所有的重新提交、修改和删除请求跟随等待事件的那次io_uring_enter一起提交
+ */
+class EventLoop;
+class Channel;
+
+class IoUringPoller : public Poller
+{
+
+public:
+    IoUringPoller(EventLoop *loop);
+    ~IoUringPoller();
+
+    // 当前内核是否可以使用io_uring(没有被禁用并且支持需要的功能)
+    static bool available();
+
+    Timestamp Poll(int timeoutMs, ChannelList *activeChannels) override;
+
+    void updateChannel(Channel *channel) override;
+
+    void removeChannel(Channel *channel) override;
+
+private:
+    // 环形队列的大小
+    static const unsigned KRingEntries = 1024;
+
+    // 每个fd上的poll请求
+    struct PollState
+    {
+        PollState() : channel(nullptr), generation(0), armedEvents(0), armed(false) {}
+        Channel *channel;    // 为空表示fd没有注册
+        uint32_t generation; // 当前poll请求的编号，用来识别已经取消的旧请求的完成事件
+        int armedEvents;     // 已提交的poll请求关注的事件
+        bool armed;          // 是否有还没完成的poll请求
+    };
+
+    // 取一个空闲的提交队列项，队列满时先提交
+    io_uring_sqe *getSqe();
+    // 把提交队列中的请求交给内核，minComplete > 0时等待完成事件
+    int enter(unsigned minComplete, unsigned flags);
+    // 提交fd上的poll请求
+    void arm(int fd, PollState &state, int events);
+    // 取消fd上的poll请求
+    void cancel(PollState &state, int fd);
+    // 提交/取消Poll的超时请求
+    void armTimeout(int timeoutMs);
+    void removeTimeout();
+    // 从完成队列中取出事件，填写活跃的连接
+    void reapCompletions(ChannelList *activeChannels);
+
+    int ringFd_;
+
+    // 提交队列
+    void *sqRing_;
+    size_t sqRingSize_;
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    unsigned *sqArray_;
+    io_uring_sqe *sqes_;
+    size_t sqesSize_;
+    unsigned sqLocalTail_; // 已经填好但还没有提交的位置
+    unsigned toSubmit_;    // 等待提交的请求个数
+
+    // 完成队列
+    void *cqRing_;
+    size_t cqRingSize_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe *cqes_;
+
+    uint32_t nextGeneration_;
+    // 下标是fd
+    std::vector<PollState> polls_;
+    // 上一次Poll中完成的fd，需要重新提交poll请求
+    std::vector<int> rearm_;
+
+    // Poll的超时请求，同一时间只保留一个
+    __kernel_timespec timeout_;
+    bool timeoutArmed_;
+    int armedTimeoutMs_;       // 已提交的超时请求的时长
+    uint64_t timeoutUserData_; // 已提交的超时请求的user_data，用来识别已经取消的旧请求
+};
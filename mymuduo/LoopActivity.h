@@ -0,0 +1,181 @@
+#pragma once
+#include "EventLoopStats.h"
+#include "noncopyable.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+/**
+ * EventLoop当前正在做的事情，给看门狗线程检测loop是否卡住使用
+ * 每轮循环记录从poll返回开始的时间，开启回调跟踪后再记录正在执行的回调(类型、fd、连接名字)
+ * 只有loop线程写，用顺序锁(seqlock)保证其他线程读到的是同一时刻的完整记录
+ */
+class LoopActivity : noncpoyable
+{
+public:
+    // 正在执行的回调类型
+    enum CallbackType
+    {
+        KNoCallback,
+        KReadCallback,
+        KWriteCallback,
+        KCloseCallback,
+        KErrorCallback,
+        KFunctorCallback, // queueINLoop投递的回调
+    };
+
+    static const int KMaxNameLength = 64;
+
+    // 某一时刻的记录
+    struct Snapshot
+    {
+        uint64_t iteration;      // 第几轮循环
+        int64_t busySinceNs;     // 这一轮从poll返回的时间，0表示在poll中等待
+        CallbackType type;       // 正在执行的回调
+        int fd;                  // 回调对应的fd，投递的回调为-1
+        int64_t callbackSinceNs; // 回调开始执行的时间
+        char name[KMaxNameLength]; // 回调所属连接的名字
+    };
+
+    LoopActivity()
+        : tracing_(false)
+        , seq_(0)
+        , iteration_(0)
+        , busySinceNs_(0)
+        , type_(KNoCallback)
+        , fd_(-1)
+        , callbackSinceNs_(0)
+    {
+        name_[0] = '\0';
+    }
+
+    static const char *typeName(CallbackType type)
+    {
+        switch (type)
+        {
+        case KReadCallback:
+            return "read";
+        case KWriteCallback:
+            return "write";
+        case KCloseCallback:
+            return "close";
+        case KErrorCallback:
+            return "error";
+        case KFunctorCallback:
+            return "functor";
+        default:
+            return "none";
+        }
+    }
+
+    // 是否记录每个回调，由看门狗开启，关闭时每个回调只多一次读取
+    bool tracing() const { return tracing_.load(std::memory_order_relaxed); }
+    void setTracing(bool on) { tracing_.store(on, std::memory_order_relaxed); }
+
+    // 以下只在loop线程中调用
+    // poll返回，开始处理这一轮的事件
+    void beginIteration(uint64_t iteration, int64_t nowNs)
+    {
+        beginWrite();
+        iteration_.store(iteration, std::memory_order_relaxed);
+        busySinceNs_.store(nowNs, std::memory_order_relaxed);
+        endWrite();
+    }
+    // 这一轮处理完，回到poll
+    void endIteration()
+    {
+        beginWrite();
+        busySinceNs_.store(0, std::memory_order_relaxed);
+        endWrite();
+    }
+    // name为nullptr表示没有所属的连接
+    void beginCallback(CallbackType type, int fd, const std::string *name, int64_t nowNs)
+    {
+        beginWrite();
+        type_.store(type, std::memory_order_relaxed);
+        fd_.store(fd, std::memory_order_relaxed);
+        callbackSinceNs_.store(nowNs, std::memory_order_relaxed);
+        size_t len = 0;
+        if (name != nullptr)
+        {
+            len = std::min(name->size(), static_cast<size_t>(KMaxNameLength - 1));
+            memcpy(name_, name->data(), len);
+        }
+        name_[len] = '\0';
+        endWrite();
+    }
+    void endCallback()
+    {
+        beginWrite();
+        type_.store(KNoCallback, std::memory_order_relaxed);
+        endWrite();
+    }
+
+    // 任意线程调用，读的过程中loop线程修改了记录就返回false
+    bool snapshot(Snapshot *snap) const
+    {
+        uint64_t seq = seq_.load(std::memory_order_acquire);
+        if (seq & 1)
+        {
+            return false;
+        }
+        snap->iteration = iteration_.load(std::memory_order_relaxed);
+        snap->busySinceNs = busySinceNs_.load(std::memory_order_relaxed);
+        snap->type = type_.load(std::memory_order_relaxed);
+        snap->fd = fd_.load(std::memory_order_relaxed);
+        snap->callbackSinceNs = callbackSinceNs_.load(std::memory_order_relaxed);
+        // 名字可能读到一半被修改，最后检查seq_发现变化时整个记录作废
+        memcpy(snap->name, name_, KMaxNameLength);
+        snap->name[KMaxNameLength - 1] = '\0';
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return seq_.load(std::memory_order_relaxed) == seq;
+    }
+
+    // 在回调执行期间记录回调，没有开启跟踪时什么都不做
+    class Scope : noncpoyable
+    {
+    public:
+        Scope(LoopActivity &activity, CallbackType type, int fd, const std::string *name = nullptr)
+            : activity_(activity.tracing() ? &activity : nullptr)
+        {
+            if (activity_ != nullptr)
+            {
+                activity_->beginCallback(type, fd, name, EventLoopStats::nowNs());
+            }
+        }
+        ~Scope()
+        {
+            if (activity_ != nullptr)
+            {
+                activity_->endCallback();
+            }
+        }
+
+    private:
+        LoopActivity *activity_;
+    };
+
+private:
+    // 写之前seq_变成奇数，写完之后变回偶数
+    void beginWrite()
+    {
+        seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    void endWrite()
+    {
+        seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    std::atomic_bool tracing_;
+    std::atomic<uint64_t> seq_;
+    std::atomic<uint64_t> iteration_;
+    std::atomic<int64_t> busySinceNs_;
+    std::atomic<CallbackType> type_;
+    std::atomic_int fd_;
+    std::atomic<int64_t> callbackSinceNs_;
+    char name_[KMaxNameLength];
+};
@@ -0,0 +1,172 @@
+#pragma once
+#include "EventLoop.h"
+#include "Logger.h"
+#include "SpscRing.h"
+#include "noncopyable.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * 一组loop之间互相发送T类型消息的通道，每对loop之间一个固定容量的SPSC环形队列
+ * 消息不需要包装成回调，也不需要加锁，适合按loop分片的状态(会话、缓存)之间通信
+ *
+ * 每个loop在每轮循环中(见EventLoop::addIterationCallback)：
+ *   1、收到过通知时一次取走所有发给自己的消息交给handler处理
+ *   2、这一轮给哪些loop发过消息，就给每个目标loop发一次通知，同一批消息只写一次eventfd
+ * 目标loop已经被通知过、还没有处理时不再重复唤醒
+ *
+ * send只能在发送方loop的线程中调用，handler在接收方loop的线程中调用
+ */
+template <typename T>
+class LoopMesh : noncpoyable
+{
+public:
+    // 处理一条消息，from为发送方loop的下标
+    using MessageHandler = std::function<void(int from, T &message)>;
+
+    // loops一般是EventLoopThreadPool::getAllLoops()，capacity为每个环形队列的容量
+    LoopMesh(const std::vector<EventLoop *> &loops, size_t capacity, const MessageHandler &handler)
+        : state_(std::make_shared<State>())
+    {
+        state_->loops = loops;
+        state_->handler = handler;
+        state_->closed = false;
+        const int n = static_cast<int>(loops.size());
+        for (int i = 0; i < n; ++i)
+        {
+            std::unique_ptr<Peer> peer(new Peer);
+            peer->signaled = false;
+            peer->flushedIteration = static_cast<uint64_t>(-1);
+            peer->pending.assign(n, false);
+            for (int from = 0; from < n; ++from)
+            { // 发给自己的位置留空
+                peer->inbox.emplace_back(from == i ? nullptr : new SpscRing<T>(capacity));
+            }
+            state_->peers.push_back(std::move(peer));
+        }
+        // loop持有state_，析构之后loop线程里的回调仍然可以安全地访问
+        for (int i = 0; i < n; ++i)
+        {
+            loops[i]->addIterationCallback(std::bind(&State::onIteration, state_, i));
+        }
+    }
+    // 析构之后不再发送和处理消息，没处理的消息随loop一起释放
+    ~LoopMesh() { state_->closed = true; }
+
+    int size() const { return static_cast<int>(state_->loops.size()); }
+    EventLoop *loop(int index) const { return state_->loops[index]; }
+    // loop的下标，不在通道中返回-1
+    int indexOf(EventLoop *loop) const
+    {
+        for (int i = 0; i < size(); ++i)
+        {
+            if (state_->loops[i] == loop)
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // 在loops[from]的线程中调用，把message发给loops[to]，在这一轮循环结束时通知目标loop
+    // 队列满时马上通知目标loop处理并返回false，由调用者决定稍后重发或者丢弃
+    bool send(int from, int to, T message)
+    {
+        State &state = *state_;
+        if (from == to || from < 0 || to < 0 || from >= size() || to >= size())
+        {
+            LOG_ERROR("%s:%s:%d  LoopMesh::send invalid route %d -> %d\n"
+                        , __FILE__, __FUNCTION__, __LINE__, from, to);
+            return false;
+        }
+        if (state.closed)
+        {
+            return false;
+        }
+        if (!state.peers[to]->inbox[from]->push(std::move(message)))
+        {
+            state.signal(to);
+            return false;
+        }
+        Peer &self = *state.peers[from];
+        if (!self.pending[to])
+        {
+            self.pending[to] = true;
+            self.dirty.push_back(to);
+            if (self.dirty.size() == 1 &&
+                state.loops[from]->stats().iterations.load(std::memory_order_relaxed) == self.flushedIteration)
+            { // 这一轮已经通知过了(比如在其他IterationCallback中发送)，投递一个空回调让loop马上进入下一轮
+                state.loops[from]->queueINLoop([] {});
+            }
+        }
+        return true;
+    }
+
+private:
+    struct Peer
+    {
+        // inbox[from]是loops[from]发给这个loop的消息
+        std::vector<std::unique_ptr<SpscRing<T>>> inbox;
+        // 已经被通知有新消息，还没有处理
+        std::atomic_bool signaled;
+        // 这一轮发过消息、还没有通知的目标loop，只在这个loop的线程中访问
+        std::vector<int> dirty;
+        std::vector<bool> pending;
+        uint64_t flushedIteration; // 最近一次通知是在第几轮循环
+    };
+
+    struct State
+    {
+        std::vector<EventLoop *> loops;
+        std::vector<std::unique_ptr<Peer>> peers;
+        MessageHandler handler;
+        std::atomic_bool closed;
+
+        // 通知loops[to]有新消息，没处理之前只通知一次
+        void signal(int to)
+        {
+            if (!peers[to]->signaled.exchange(true))
+            {
+                loops[to]->wakeup();
+            }
+        }
+
+        // 每轮循环在loops[index]的线程中调用
+        size_t onIteration(int index)
+        {
+            if (closed)
+            {
+                return 0;
+            }
+            Peer &self = *peers[index];
+            size_t count = 0;
+            if (self.signaled.load(std::memory_order_relaxed))
+            {
+                // 先清掉通知再取消息：发送方要么看到通知已经清掉重新唤醒loop，要么它的消息这次就能取到
+                self.signaled.exchange(false);
+                for (int from = 0; from < static_cast<int>(self.inbox.size()); ++from)
+                {
+                    if (self.inbox[from])
+                    {
+                        count += self.inbox[from]->consume([this, from](T &message) { handler(from, message); });
+                    }
+                }
+            }
+            // 处理消息时发出的消息也在这里一起通知
+            self.flushedIteration = loops[index]->stats().iterations.load(std::memory_order_relaxed);
+            for (int to : self.dirty)
+            {
+                self.pending[to] = false;
+                signal(to);
+            }
+            self.dirty.clear();
+            return count;
+        }
+    };
+
+    std::shared_ptr<State> state_;
+};
@@ -0,0 +1,221 @@
+#pragma once
+#include "noncopyable.h"
+
+#include <atomic>
+#include <limits>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * 无锁的多生产者单消费者队列(单向链表，节点由队列分配，包着元素)
+ * 生产者用CAS把节点压到链表头部，消费者用一次exchange把整个链表取走，
+ * 反转之后按入队的顺序处理，取走之后新入队的元素留到下一次处理
+ * 消费者可以限制一次处理的个数，没有处理完的元素按顺序留在消费者自己的链表中，下次优先处理
+ *
+ * 节点会被循环使用：消费者处理完的节点一次性还到freeList_中，
+ * 生产者从自己线程中这个队列的缓存里取节点，缓存空了再用exchange把freeList_整个取走，
+ * 稳定运行时push不会再分配内存
+ * 线程的缓存按队列分开，一个线程向多个队列push(比如mainloop向各个subloop投递)时，
+ * 节点不会从一个队列的freeList_跑到另一个队列中
+ */
+template <typename T>
+class MpscQueue : noncpoyable
+{
+public:
+    MpscQueue() : id_(nextId().fetch_add(1, std::memory_order_relaxed)), head_(nullptr), freeList_(nullptr), pending_(nullptr), pendingTail_(nullptr) {}
+    ~MpscQueue()
+    {
+        destroyList(head_.load());
+        destroyList(pending_);
+        deleteList(freeList_.load());
+    }
+
+    // 入队，可以在任意线程调用
+    void push(T value)
+    {
+        Node *node = allocNode();
+        ::new (&node->storage) T(std::move(value));
+        Node *old = head_.load(std::memory_order_relaxed);
+        do
+        {
+            node->next = old;
+        } while (!head_.compare_exchange_weak(old, node));
+    }
+
+    // 包括上次没有处理完的元素，只能由消费者线程调用
+    bool empty() const { return pending_ == nullptr && head_.load() == nullptr; }
+
+    // 取出当前队列中所有的元素，按入队顺序交给func处理，返回处理的个数
+    // 只能由消费者线程调用
+    template <typename Func>
+    size_t consumeAll(Func func)
+    {
+        return consume(std::numeric_limits<size_t>::max(), func);
+    }
+
+    // 按入队顺序最多处理maxCount个元素，剩下的留到下一次，返回处理的个数
+    // 只能由消费者线程调用
+    template <typename Func>
+    size_t consume(size_t maxCount, Func func)
+    {
+        Node *node = head_.exchange(nullptr);
+        if (node != nullptr)
+        {
+            // 链表是后进先出的顺序，先反转，再接到上次剩下的元素后面
+            Node *reversed = nullptr;
+            Node *last = node; // 反转后的最后一个节点
+            while (node)
+            {
+                Node *next = node->next;
+                node->next = reversed;
+                reversed = node;
+                node = next;
+            }
+            if (pending_ == nullptr)
+            {
+                pending_ = reversed;
+            }
+            else
+            {
+                pendingTail_->next = reversed;
+            }
+            pendingTail_ = last;
+        }
+
+        Node *first = pending_;
+        Node *last = nullptr;
+        size_t count = 0;
+        while (pending_ != nullptr && count < maxCount)
+        {
+            last = pending_;
+            pending_ = pending_->next;
+            func(*last->value());
+            // 元素处理完马上析构，释放它持有的资源
+            last->value()->~T();
+            ++count;
+        }
+        if (pending_ == nullptr)
+        {
+            pendingTail_ = nullptr;
+        }
+        if (count == 0)
+        {
+            return 0;
+        }
+        // 处理完的节点整条链一次还到freeList_中
+        Node *old = freeList_.load(std::memory_order_relaxed);
+        do
+        {
+            last->next = old;
+        } while (!freeList_.compare_exchange_weak(old, first, std::memory_order_release, std::memory_order_relaxed));
+        return count;
+    }
+
+private:
+    struct Node
+    {
+        Node *next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        T *value() { return reinterpret_cast<T *>(&storage); }
+    };
+
+    // 一个线程最多为多少个队列缓存节点，超过之后释放最早的缓存
+    // 队列析构时不能修改其他线程的缓存，靠这个上限回收已经析构的队列留下的节点
+    static const size_t KMaxCachedQueues = 64;
+
+    // 每个生产者线程缓存的空闲节点，按队列编号分开，线程退出时释放
+    struct NodeCache
+    {
+        struct Entry
+        {
+            uint64_t queueId;
+            Node *head;
+        };
+
+        ~NodeCache()
+        {
+            for (Entry &entry : entries)
+            {
+                deleteList(entry.head);
+            }
+        }
+
+        // 一个线程一般只向少数几个队列push，线性查找就够了
+        Node *&headFor(uint64_t queueId)
+        {
+            for (Entry &entry : entries)
+            {
+                if (entry.queueId == queueId)
+                {
+                    return entry.head;
+                }
+            }
+            if (entries.size() >= KMaxCachedQueues)
+            {
+                deleteList(entries.front().head);
+                entries.erase(entries.begin());
+            }
+            entries.push_back(Entry{queueId, nullptr});
+            return entries.back().head;
+        }
+
+        std::vector<Entry> entries;
+    };
+
+    // 队列编号不会重复使用，析构的队列留下的缓存不会被新的队列拿到
+    static std::atomic<uint64_t> &nextId()
+    {
+        static std::atomic<uint64_t> id(0);
+        return id;
+    }
+
+    static void destroyList(Node *node)
+    {
+        while (node)
+        {
+            Node *next = node->next;
+            node->value()->~T();
+            delete node;
+            node = next;
+        }
+    }
+
+    static void deleteList(Node *node)
+    {
+        while (node)
+        {
+            Node *next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    // 只有生产者取走整个freeList_，不会有ABA问题
+    Node *allocNode()
+    {
+        static thread_local NodeCache cache;
+        Node *&head = cache.headFor(id_);
+        if (head == nullptr)
+        {
+            head = freeList_.exchange(nullptr, std::memory_order_acquire);
+        }
+        if (head)
+        {
+            Node *node = head;
+            head = node->next;
+            return node;
+        }
+        return new Node;
+    }
+
+    const uint64_t id_; // 区分线程缓存属于哪个队列
+    std::atomic<Node *> head_;
+    std::atomic<Node *> freeList_;
+    // 消费者没有处理完的元素(按入队顺序)，只有消费者访问
+    Node *pending_;
+    Node *pendingTail_;
+};
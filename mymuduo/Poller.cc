@@ -4,6 +4,5 @@
 // 判断参数Channel时候在当前Poller中
 bool Poller::hasChannel(Channel *channel) const
 {
-    auto it = channels_.find(channel->fd());
-    return it != channels_.end() && it->second == channel;
+    return channels_.find(channel->fd()) == channel;
 }
\ No newline at end of file
@@ -1,8 +1,8 @@
 #pragma once
+#include "ChannelTable.h"
 #include "noncopyable.h"
 #include "Timestamp.h"
 
-#include <unordered_map>
 #include <vector>
 
 class EventLoop;
@@ -16,6 +16,15 @@ class Poller : noncpoyable
 
 public:
     using ChannelList = std::vector<Channel *>;
+
+    // IO复用的具体实现
+    enum Backend
+    {
+        KDefaultBackend, // 由环境变量决定
+        KEpollBackend,
+        KIoUringBackend,
+    };
+
     Poller(EventLoop *loop):ownerLoop_(loop){}
     virtual ~Poller() = default;
     
@@ -28,17 +37,22 @@ public:
     // 删除Poller中注册的Channel
     virtual void removeChannel(Channel*channel) = 0;
 
+    // 是否支持边沿触发(EPOLLET)
+    virtual bool supportsEdgeTriggered() const { return false; }
+    // 是否支持独占唤醒(EPOLLEXCLUSIVE)
+    virtual bool supportsExclusiveWakeup() const { return false; }
+
     // 判断参数Channel时候在当前Poller中
     bool hasChannel(Channel*channel)const;
 
     // EventLoop事件循环通过该接口获取默认的IO复用的具体实现(poll / epoll)
     // 这个接口在派生类中实现的。因为只有当派生出poll或者epoll才知道如何实现这个函数
     static Poller* newDefaultPoller(EventLoop *loop);
+    // 使用指定的IO复用实现，io_uring不可用时退回到epoll
+    static Poller *newPoller(EventLoop *loop, Backend backend);
 protected:
-    // 使用hashTable保存Poller监听的Channel
-    // hashtable的key->sockfd,value->sockfd对应的Channel
-    using ChannelMap = std::unordered_map<int, Channel *>;
-    ChannelMap channels_;
+    // 保存Poller监听的Channel，下标是sockfd，值是sockfd对应的Channel和注册编号
+    ChannelTable channels_;
 
 private:
     // 保存Poller所属的EventLoop
@@ -0,0 +1,62 @@
+#include "RateLimiter.h"
+
+#include <algorithm>
+
+RateLimiter::RateLimiter(double ratePerSecond, double burst, size_t maxKeys)
+    : ratePerUs_(ratePerSecond / 1000000.0)
+    , burst_(std::max(burst, 1.0))
+    , maxKeys_(maxKeys)
+{
+}
+
+bool RateLimiter::allow(uint32_t key, int64_t nowUs)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<uint32_t, Bucket>::iterator it = buckets_.find(key);
+    if (it == buckets_.end())
+    {
+        if (buckets_.size() >= maxKeys_)
+        {
+            prune(nowUs);
+        }
+        // 新的key从满桶开始
+        Bucket bucket = {burst_ - 1, nowUs};
+        buckets_.insert(std::make_pair(key, bucket));
+        return true;
+    }
+    Bucket &bucket = it->second;
+    bucket.tokens = std::min(burst_, bucket.tokens + (nowUs - bucket.lastUs) * ratePerUs_);
+    bucket.lastUs = nowUs;
+    if (bucket.tokens < 1)
+    {
+        return false;
+    }
+    bucket.tokens -= 1;
+    return true;
+}
+
+size_t RateLimiter::size()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buckets_.size();
+}
+
+// 已经攒满令牌的桶和新建的一样，删掉不影响限速
+void RateLimiter::prune(int64_t nowUs)
+{
+    for (std::unordered_map<uint32_t, Bucket>::iterator it = buckets_.begin(); it != buckets_.end();)
+    {
+        if (it->second.tokens + (nowUs - it->second.lastUs) * ratePerUs_ >= burst_)
+        {
+            it = buckets_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    if (buckets_.size() >= maxKeys_)
+    { // 同时活跃的客户端太多，放弃之前的记录
+        buckets_.clear();
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "noncopyable.h"
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+
+/**
+ * 按key(比如客户端IP)分别限速的令牌桶，每个key每秒补充rate个令牌，最多攒burst个
+ * 多个loop可能同时调用allow，用一把锁保护
+ * key的个数超过maxKeys时清理已经攒满令牌(很久没有请求)的桶，清理之后仍然太多就全部清空
+ */
+class RateLimiter : noncpoyable
+{
+public:
+    RateLimiter(double ratePerSecond, double burst, size_t maxKeys = KDefaultMaxKeys);
+
+    // 消耗key的一个令牌，没有令牌时返回false，nowUs用单调时钟(Timestamp::monotonicNow)
+    bool allow(uint32_t key, int64_t nowUs);
+
+    size_t size();
+
+    static const size_t KDefaultMaxKeys = 65536;
+
+private:
+    struct Bucket
+    {
+        double tokens;
+        int64_t lastUs; // 上次补充令牌的时间
+    };
+
+    void prune(int64_t nowUs);
+
+    const double ratePerUs_;
+    const double burst_;
+    const size_t maxKeys_;
+    std::mutex mutex_;
+    std::unordered_map<uint32_t, Bucket> buckets_;
+};
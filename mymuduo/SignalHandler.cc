@@ -0,0 +1,83 @@
+#include "SignalHandler.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+static int createSignalfd(const sigset_t &mask)
+{
+    int fd = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_FATAL("%s:%s:%d   signalfd error:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return fd;
+}
+
+SignalHandler::SignalHandler(EventLoop *loop)
+    : loop_(loop)
+{
+    sigemptyset(&mask_);
+    signalFd_ = createSignalfd(mask_);
+    signalChannel_.reset(new Channel(loop_, signalFd_));
+    signalChannel_->setReadCallback(std::bind(&SignalHandler::handleRead, this));
+    signalChannel_->enableReading();
+}
+
+SignalHandler::~SignalHandler()
+{
+    signalChannel_->disableAll();
+    signalChannel_->remove();
+    ::close(signalFd_);
+    // 只能恢复当前线程的屏蔽字
+    ::pthread_sigmask(SIG_UNBLOCK, &mask_, nullptr);
+}
+
+void SignalHandler::add(int signo, const SignalCallback &cb)
+{
+    callbacks_[signo] = cb;
+    if (sigismember(&mask_, signo))
+    {
+        return;
+    }
+    sigaddset(&mask_, signo);
+    ::pthread_sigmask(SIG_BLOCK, &mask_, nullptr);
+    if (::signalfd(signalFd_, &mask_, 0) < 0)
+    {
+        LOG_ERROR("%s:%s:%d   signalfd add signal %d error:%d \n", __FILE__, __FUNCTION__, __LINE__, signo, errno);
+    }
+}
+
+// 一次读出所有到达的信号，按到达的顺序执行回调
+void SignalHandler::handleRead()
+{
+    signalfd_siginfo infos[8];
+    for (;;)
+    {
+        ssize_t n = ::read(signalFd_, infos, sizeof infos);
+        if (n <= 0)
+        {
+            if (n < 0 && errno != EAGAIN)
+            {
+                LOG_ERROR("%s:%s:%d   read signalfd error:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+            }
+            break;
+        }
+        const int count = static_cast<int>(n / sizeof(signalfd_siginfo));
+        for (int i = 0; i < count; ++i)
+        {
+            const int signo = static_cast<int>(infos[i].ssi_signo);
+            LOG_INFO("%s:%s:%d   SignalHandler receive signal %d from pid %u\n"
+                        , __FILE__, __FUNCTION__, __LINE__, signo, infos[i].ssi_pid);
+            std::map<int, SignalCallback>::iterator it = callbacks_.find(signo);
+            if (it != callbacks_.end() && it->second)
+            {
+                it->second(signo);
+            }
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "noncopyable.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <signal.h>
+
+class Channel;
+class EventLoop;
+
+/**
+ * 用signalfd把信号变成loop上的一个可读事件，信号的回调和其他回调一样在loop线程中执行
+ * 回调中可以做任何事情(比如调用TcpServer::stop)，不受异步信号安全的限制
+ *
+ * 信号必须在所有线程中都被屏蔽，否则内核可能把信号交给其他线程按默认方式处理
+ * 新线程继承创建者的信号屏蔽字，所以要在创建其他线程之前(TcpServer::start之前)调用add：
+ *   EventLoop loop;
+ *   SignalHandler signals(&loop);
+ *   signals.add(SIGTERM, [&](int) { server.stop(10.0, [&] { loop.quit(); }); });
+ *   server.start();
+ *   loop.loop();
+ */
+class SignalHandler : noncpoyable
+{
+public:
+    using SignalCallback = std::function<void(int signo)>;
+
+    explicit SignalHandler(EventLoop *loop);
+    ~SignalHandler();
+
+    // 在loop线程中调用，屏蔽signo并在收到时执行cb，同一个信号后设置的回调覆盖之前的
+    void add(int signo, const SignalCallback &cb);
+
+private:
+    void handleRead();
+
+    EventLoop *loop_;
+    sigset_t mask_;
+    int signalFd_;
+    std::unique_ptr<Channel> signalChannel_;
+    std::map<int, SignalCallback> callbacks_;
+};
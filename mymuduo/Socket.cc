@@ -10,6 +10,10 @@
 #include <strings.h>
 #include <netinet/tcp.h>
 
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69 // linux 5.11
+#endif
+
 Socket::~Socket()
 {
     ::close(sockfd_);
@@ -81,4 +85,20 @@ void Socket::setKeepAlive(bool on)
 {
     int optval = on ? 1:0;
     ::setsockopt(sockfd_,SOL_SOCKET,SO_KEEPALIVE,&optval,sizeof optval);
-}
\ No newline at end of file
+}
+
+bool Socket::setBusyPoll(int usec, bool prefer)
+{
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof usec) < 0)
+    {
+        return false;
+    }
+    int optval = prefer ? 1 : 0;
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_PREFER_BUSY_POLL, &optval, sizeof optval) == 0;
+}
+
+bool Socket::setZeroCopy(bool on)
+{
+    int optval = on ? 1:0;
+    return ::setsockopt(sockfd_,SOL_SOCKET,SO_ZEROCOPY,&optval,sizeof optval) == 0;
+}
@@ -25,6 +25,10 @@ public:
     void setReuseAddr(bool on);
     void setReusePort(bool on);
     void setKeepAlive(bool on);
+    // 开启SO_ZEROCOPY，内核不支持时返回false
+    bool setZeroCopy(bool on);
+    // 设置SO_BUSY_POLL(微秒)，prefer为true时同时设置SO_PREFER_BUSY_POLL，失败返回false
+    bool setBusyPoll(int usec, bool prefer);
 private:
     const int sockfd_;
 };
@@ -0,0 +1,111 @@
+#pragma once
+#include "noncopyable.h"
+
+#include <atomic>
+#include <new>
+#include <stddef.h>
+#include <type_traits>
+#include <utility>
+
+/**
+ * 固定容量的单生产者单消费者环形队列，无锁也不分配内存
+ * 生产者只写tail_，消费者只写head_，生产者缓存消费者的下标，只有队列看起来满了才读消费者的缓存行
+ * 消费者一次取走当前所有的元素批量处理
+ */
+template <typename T>
+class SpscRing : noncpoyable
+{
+public:
+    // 容量向上取整为2的幂
+    explicit SpscRing(size_t capacity)
+        : capacity_(roundUp(capacity))
+        , mask_(capacity_ - 1)
+        , slots_(new Slot[capacity_])
+        , head_(0)
+        , tail_(0)
+        , cachedHead_(0)
+    {
+    }
+    ~SpscRing()
+    {
+        consume([](T &) {});
+        delete[] slots_;
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    // 入队，只能由生产者线程调用，队列满时返回false
+    bool push(T value)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cachedHead_ == capacity_)
+        {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            if (tail - cachedHead_ == capacity_)
+            {
+                return false;
+            }
+        }
+        ::new (&slots_[tail & mask_].storage) T(std::move(value));
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 取出当前队列中所有的元素，按入队顺序交给func处理，返回处理的个数
+    // 只能由消费者线程调用
+    template <typename Func>
+    size_t consume(Func func)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        size_t index = head;
+        while (index != tail)
+        {
+            T *value = slots_[index & mask_].value();
+            func(*value);
+            value->~T();
+            ++index;
+        }
+        if (index != head)
+        { // 处理完一次归还所有的位置
+            head_.store(index, std::memory_order_release);
+        }
+        return index - head;
+    }
+
+    // 只能由消费者线程调用
+    bool empty() const { return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire); }
+
+private:
+    struct Slot
+    {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        T *value() { return reinterpret_cast<T *>(&storage); }
+    };
+
+    static const size_t KCacheLine = 64;
+
+    static size_t roundUp(size_t n)
+    {
+        size_t capacity = 2;
+        while (capacity < n)
+        {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    const size_t capacity_;
+    const size_t mask_;
+    Slot *const slots_;
+
+    // 消费者使用的数据，和生产者的数据放在不同的缓存行上
+    char pad0_[KCacheLine];
+    std::atomic<size_t> head_;
+
+    // 生产者使用的数据
+    char pad1_[KCacheLine];
+    std::atomic<size_t> tail_;
+    size_t cachedHead_;
+    char pad2_[KCacheLine];
+};
@@ -0,0 +1,140 @@
+#include "StallWatchdog.h"
+#include "EventLoop.h"
+#include "EventLoopStats.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <chrono>
+
+StallWatchdog::StallWatchdog(int thresholdMs, const StallCallback &cb)
+    : thresholdNs_(static_cast<int64_t>(thresholdMs) * 1000 * 1000)
+    , stallCallback_(cb ? cb : defaultStallCallback)
+    , running_(false)
+    , thread_(std::bind(&StallWatchdog::threadFunc, this), "StallWatchdog")
+{
+}
+
+StallWatchdog::~StallWatchdog()
+{
+    stop();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Watched &watched : loops_)
+    {
+        watched.loop->activity().setTracing(false);
+    }
+}
+
+void StallWatchdog::start()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_ || thread_.started())
+        {
+            return;
+        }
+        running_ = true;
+    }
+    thread_.start();
+}
+
+void StallWatchdog::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_)
+        {
+            return;
+        }
+        running_ = false;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+void StallWatchdog::watch(EventLoop *loop)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Watched watched = {loop, 0};
+    loops_.push_back(watched);
+    loop->activity().setTracing(true);
+}
+
+void StallWatchdog::unwatch(EventLoop *loop)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = loops_.begin(); it != loops_.end(); ++it)
+    {
+        if (it->loop == loop)
+        {
+            loop->activity().setTracing(false);
+            loops_.erase(it);
+            break;
+        }
+    }
+}
+
+void StallWatchdog::defaultStallCallback(const StallInfo &info)
+{
+    LOG_ERROR("%s:%s:%d  EventLoop %p (tid %d) stalled %ld ms in iteration %lu: %s callback fd=%d [%s] running %ld ms\n"
+                , __FILE__, __FUNCTION__, __LINE__, info.loop, info.tid, (long)(info.iterationUs / 1000)
+                , (unsigned long)info.iteration, LoopActivity::typeName(info.type), info.fd, info.name.c_str()
+                , (long)(info.callbackUs / 1000));
+}
+
+void StallWatchdog::threadFunc()
+{
+    // 检查的间隔为阈值的1/4，卡住的loop最晚在1.25倍阈值时被发现
+    const std::chrono::nanoseconds interval(std::max<int64_t>(thresholdNs_ / 4, 1000 * 1000));
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_)
+    {
+        cond_.wait_for(lock, interval);
+        if (!running_)
+        {
+            break;
+        }
+        std::vector<StallInfo> stalls = check();
+        if (!stalls.empty())
+        { // 报告回调中可能调用unwatch，不能持有锁
+            lock.unlock();
+            for (const StallInfo &info : stalls)
+            {
+                stallCallback_(info);
+            }
+            lock.lock();
+        }
+    }
+}
+
+// 在持有mutex_时调用
+std::vector<StallWatchdog::StallInfo> StallWatchdog::check()
+{
+    std::vector<StallInfo> stalls;
+    const int64_t now = EventLoopStats::nowNs();
+    for (Watched &watched : loops_)
+    {
+        LoopActivity::Snapshot snap;
+        if (!watched.loop->activity().snapshot(&snap))
+        { // 读的时候loop正在修改记录，说明loop没有卡住
+            continue;
+        }
+        if (snap.busySinceNs == 0 || snap.busySinceNs == watched.reportedSinceNs ||
+            now - snap.busySinceNs < thresholdNs_)
+        { // 在poll中等待、这一轮已经报告过或者还没有超过阈值
+            continue;
+        }
+        watched.reportedSinceNs = snap.busySinceNs;
+
+        StallInfo info;
+        info.loop = watched.loop;
+        info.tid = watched.loop->threadId();
+        info.iteration = snap.iteration;
+        info.iterationUs = (now - snap.busySinceNs) / 1000;
+        info.type = snap.type;
+        info.fd = snap.type == LoopActivity::KNoCallback ? -1 : snap.fd;
+        info.name = snap.type == LoopActivity::KNoCallback ? std::string() : snap.name;
+        info.callbackUs = snap.type == LoopActivity::KNoCallback ? 0 : (now - snap.callbackSinceNs) / 1000;
+        stalls.push_back(info);
+    }
+    return stalls;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "LoopActivity.h"
+#include "Thread.h"
+#include "noncopyable.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+class EventLoop;
+
+/**
+ * loop卡住检测：一个单独的线程定期检查被监视的loop，
+ * 一轮循环从poll返回之后超过阈值还没有回到poll，就报告正在执行的回调(类型、fd、连接名字)和已经执行的时间
+ * 比如一个很慢的messageCallback会卡住同一个subloop上的所有连接
+ * 每轮循环只报告一次，报告回调在看门狗线程中执行
+ */
+class StallWatchdog : noncpoyable
+{
+public:
+    struct StallInfo
+    {
+        EventLoop *loop;
+        pid_t tid;                     // loop线程的tid，可以用tgkill发信号抓取loop线程的调用栈
+        uint64_t iteration;            // 卡住的是第几轮循环
+        int64_t iterationUs;           // 这一轮已经执行的时间(微秒)
+        LoopActivity::CallbackType type; // 正在执行的回调
+        int fd;                        // 回调对应的fd，投递的回调为-1
+        std::string name;              // 回调所属连接的名字
+        int64_t callbackUs;            // 当前回调已经执行的时间(微秒)
+    };
+    using StallCallback = std::function<void(const StallInfo &)>;
+
+    // 一轮循环超过thresholdMs毫秒就报告，cb为空时用defaultStallCallback打印日志
+    explicit StallWatchdog(int thresholdMs, const StallCallback &cb = StallCallback());
+    ~StallWatchdog();
+
+    // 启动/停止看门狗线程
+    void start();
+    void stop();
+
+    // 监视loop并开启loop的回调跟踪，任意线程都可以调用
+    void watch(EventLoop *loop);
+    // 取消监视，loop析构之前必须调用(或者先stop)
+    void unwatch(EventLoop *loop);
+
+    static void defaultStallCallback(const StallInfo &info);
+
+private:
+    struct Watched
+    {
+        EventLoop *loop;
+        int64_t reportedSinceNs; // 已经报告过的那一轮的开始时间
+    };
+
+    void threadFunc();
+    // 检查所有的loop，返回需要报告的
+    std::vector<StallInfo> check();
+
+    const int64_t thresholdNs_;
+    StallCallback stallCallback_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool running_;
+    std::vector<Watched> loops_;
+    Thread thread_;
+};
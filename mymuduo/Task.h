@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * EventLoop使用的回调类型，只能移动不能拷贝的void()可调用对象
+ * 不大于KInlineSize的可调用对象(比如捕获一个TcpConnectionPtr再加几个指针的lambda/bind)
+ * 直接保存在对象内部，不需要在堆上分配内存；更大的可调用对象才放到堆上
+ */
+class Task
+{
+public:
+    // 内部存储的大小：一个shared_ptr加上四个指针
+    static const size_t KInlineSize = 48;
+
+    Task() : ops_(nullptr) {}
+    Task(std::nullptr_t) : ops_(nullptr) {}
+
+    template <typename F,
+              typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F &&f) : ops_(nullptr)
+    {
+        using Func = typename std::decay<F>::type;
+        init<Func>(std::forward<F>(f), std::integral_constant<bool, storedInline<Func>()>());
+    }
+
+    Task(Task &&other) : ops_(nullptr) { moveFrom(other); }
+
+    Task &operator=(Task &&other)
+    {
+        if (this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() { reset(); }
+
+    void operator()() { ops_->invoke(&storage_); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    // 释放保存的可调用对象(以及它捕获的资源)
+    void reset()
+    {
+        if (ops_)
+        {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    using Storage = typename std::aligned_storage<KInlineSize, alignof(std::max_align_t)>::type;
+
+    // 不同类型的可调用对象的操作表
+    struct Ops
+    {
+        void (*invoke)(void *);
+        void (*move)(void *dst, void *src); // 移动到dst并析构src
+        void (*destroy)(void *);
+    };
+
+    // 可以放在内部存储中的类型
+    template <typename F>
+    static constexpr bool storedInline()
+    {
+        return sizeof(F) <= KInlineSize && alignof(F) <= alignof(Storage) &&
+               std::is_nothrow_move_constructible<F>::value;
+    }
+
+    template <typename F>
+    struct InlineOps
+    {
+        static void invoke(void *p) { (*static_cast<F *>(p))(); }
+        static void move(void *dst, void *src)
+        {
+            ::new (dst) F(std::move(*static_cast<F *>(src)));
+            static_cast<F *>(src)->~F();
+        }
+        static void destroy(void *p) { static_cast<F *>(p)->~F(); }
+        static const Ops ops;
+    };
+
+    template <typename F>
+    struct HeapOps
+    {
+        static void invoke(void *p) { (**static_cast<F **>(p))(); }
+        static void move(void *dst, void *src) { *static_cast<F **>(dst) = *static_cast<F **>(src); }
+        static void destroy(void *p) { delete *static_cast<F **>(p); }
+        static const Ops ops;
+    };
+
+    template <typename F, typename Arg>
+    void init(Arg &&f, std::true_type)
+    {
+        ::new (&storage_) F(std::forward<Arg>(f));
+        ops_ = &InlineOps<F>::ops;
+    }
+
+    template <typename F, typename Arg>
+    void init(Arg &&f, std::false_type)
+    {
+        *reinterpret_cast<F **>(&storage_) = new F(std::forward<Arg>(f));
+        ops_ = &HeapOps<F>::ops;
+    }
+
+    void moveFrom(Task &other)
+    {
+        if (other.ops_)
+        {
+            other.ops_->move(&storage_, &other.storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    Storage storage_;
+    const Ops *ops_;
+};
+
+template <typename F>
+const Task::Ops Task::InlineOps<F>::ops = {&Task::InlineOps<F>::invoke, &Task::InlineOps<F>::move, &Task::InlineOps<F>::destroy};
+
+template <typename F>
+const Task::Ops Task::HeapOps<F>::ops = {&Task::HeapOps<F>::invoke, &Task::HeapOps<F>::move, &Task::HeapOps<F>::destroy};
@@ -4,6 +4,18 @@
 #include "Logger.h"
 #include "Socket.h"
 
+#include <algorithm>
+#include <errno.h>
+#include <limits.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
 // 检测baseloop是否为空，如果为空程序直接退出
 static EventLoop *checkNotNull(EventLoop *loop)
 {
@@ -23,18 +35,30 @@ TcpConnection::TcpConnection(EventLoop *loop,
     , name_(nameArg)
     , state_(KConnecting)
     , reading_(true)
+    , edgeTriggered_(false)
+    , outstandingJobs_(0)
+    , computeThrottled_(false)
     , socket_(new Socket(sockfd))
     , channel_(new Channel(loop, sockfd))
     , localAddr_(localAddr)
     , peerAddr_(peerAddr)
+    , readWaiter_(nullptr)
+    , writeWaiter_(nullptr)
     , highWaterMark_(64 * 1024 * 1024) // 64M
+    , outputBuffer_(loop_->bufferPool()) // 发送缓冲区使用分段模式，数据堆积时append不会搬动已有数据
+    , regionBufferBytes_(0)
+    , zeroCopy_(false)
+    , zeroCopyThreshold_(KDefaultZeroCopyThreshold)
+    , zeroCopyNextId_(0)
+    , zeroCopyStats_()
 {
     channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
     channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
     channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
     channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+    channel_->setName(name_);
 
-    LOG_INFO("%s:%s:%d   TcpConnection::TcpConnection [%s] at %p fd=%d\n"
+    LOG_DEBUG("%s:%s:%d   TcpConnection::TcpConnection [%s] at %p fd=%d\n"
                 , __FILE__, __FUNCTION__, __LINE__, name_.c_str(), this, sockfd);
 
     socket_->setKeepAlive(true);
@@ -43,28 +67,135 @@ TcpConnection::~TcpConnection()
 {
     LOG_INFO("%s:%s:%d   TcpConnection::~TcpConnection [%s] at %p fd=%d state=%d"
             , __FILE__, __FUNCTION__, __LINE__, name_.c_str(), this, channel_->fd(), (int)state_);
+    // 还在等待的协程(正常情况下连接关闭时已经恢复了)不能再访问这个连接
+    if (readWaiter_ != nullptr)
+    {
+        readWaiter_->detach();
+    }
+    if (writeWaiter_ != nullptr)
+    {
+        writeWaiter_->detach();
+    }
+}
+
+const InetAddress &TcpConnection::localAddress() const
+{
+    if (localAddr_.getsockaddr()->sin_addr.s_addr == htonl(INADDR_ANY))
+    {
+        sockaddr_in localaddr;
+        bzero(&localaddr, sizeof localaddr);
+        socklen_t addrlen = sizeof localaddr;
+        if (::getsockname(channel_->fd(), (sockaddr *)&localaddr, &addrlen) == 0)
+        {
+            localAddr_.setSockAddrInet(localaddr);
+        }
+        else
+        {
+            LOG_ERROR("%s:%s:%d   TcpConnection::localAddress getsockname error %d\n"
+                        , __FILE__, __FUNCTION__, __LINE__, errno);
+        }
+    }
+    return localAddr_;
 }
 
 // 可读事件的回调
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
-    int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
-    if (n > 0)
+    // 水平触发读一次就够了，边沿触发要一直读到socket中没有数据为止
+    // 为了公平，每轮读取的数据超过loop的限制时先停下来，让同一个loop上的其他连接先处理
+    const size_t maxBytes = loop_->maxReadBytesPerIteration();
+    size_t totalBytes = 0;
+    for (;;)
     {
-        // shared_from_this 获取当前对象的
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        int savedErrno = 0;
+        const size_t capacity = inputBuffer_.readCapacity();
+        ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+        if (n > 0)
+        {
+            if (idleWheel_)
+            { // 记录连接有活动
+                idleWheel_->touch(&idleEntry_);
+            }
+            if (readWaiter_ != nullptr)
+            { // 有协程在等待数据，数据留在inputBuffer_中由协程读取
+                notifyWaiter(readWaiter_);
+            }
+            else if (messageCallback_)
+            {
+                // shared_from_this 获取当前对象的
+                messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+            }
+            // 读到的比能读入的少，说明socket中的数据已经读完了，不需要再读一次等EAGAIN
+            // 回调中暂停了读取(比如提交的任务太多)时剩下的数据留在socket中
+            if (!channel_->edgeTriggered() || static_cast<size_t>(n) < capacity || state_ == KDisconnected || !reading_)
+            {
+                break;
+            }
+            totalBytes += n;
+            if (maxBytes > 0 && totalBytes >= maxBytes)
+            { // 边沿触发不会再通知socket中剩下的数据，排到回调队列的最后继续读
+                loop_->queueINLoop(std::bind(&TcpConnection::continueRead, shared_from_this()));
+                break;
+            }
+        }
+        else if(n == 0)
+        {
+            handleClose();
+            break;
+        }
+        else
+        {
+            if (channel_->edgeTriggered() && savedErrno == EWOULDBLOCK)
+            {
+                break;
+            }
+            errno = savedErrno;
+            LOG_ERROR("%s:%s:%d   TcpConnection::handleRead error"
+                        , __FILE__, __FUNCTION__, __LINE__);
+            handleError();
+            break;
+        }
     }
-    else if(n == 0)
+}
+
+// 上一轮超过读取限制时留下的数据
+void TcpConnection::continueRead()
+{
+    if ((state_ == KConnected || state_ == KDisconnecting) && reading_)
     {
-        handleClose();
+        handleRead(loop_->pollReturnTime());
     }
-    else
+}
+
+void TcpConnection::startRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::startReadInLoop()
+{
+    if (!reading_ && state_ == KConnected)
     {
-        errno = savedErrno;
-        LOG_ERROR("%s:%s:%d   TcpConnection::handleRead error"
-                    , __FILE__, __FUNCTION__, __LINE__);
-        handleError();
+        reading_ = true;
+        channel_->enableReading();
+        if (channel_->edgeTriggered())
+        { // 暂停期间到达的数据不一定会再通知，主动读一次
+            loop_->queueINLoop(std::bind(&TcpConnection::continueRead, shared_from_this()));
+        }
+    }
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    if (reading_ && state_ == KConnected)
+    {
+        reading_ = false;
+        channel_->disableReading();
     }
 }
 
@@ -73,18 +204,21 @@ void TcpConnection::handleWrite()
 {
     if (channel_->isWriteing())
     { // 当前连接注册了可写事件
+        if (idleWheel_)
+        {
+            idleWheel_->touch(&idleEntry_);
+        }
         int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
-        if (n > 0)
+        if (writeOutput(&savedErrno))
         {
-            outputBuffer_.retrieve(n); // 数据读取完毕，调整readIndex_的位置
-            if (outputBuffer_.readableBytes() == 0)
-            {                               // 数据已经写完
+            if (outputBuffer_.readableBytes() == 0 && outputRegions_.empty())
+            {                               // 数据和文件都已经写完
                 channel_->disableWriting(); // 将fd设置为不可写
                 if (writeCompleteCallback_)
                 { // 调用写完成后的回调函数
-                    loop_->queueINLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                    queueWriteComplete();
                 }
+                notifyWaiter(writeWaiter_);
                 // 如果写入数据后正在关闭连接，服务器也会断开连接
                 if (state_ == KDisconnecting)
                 {
@@ -94,8 +228,7 @@ void TcpConnection::handleWrite()
         }
         else
         {
-            LOG_ERROR("%s:%s:%d   TcpConnection::handlerWrite error %d\n"
-                    , __FILE__, __FUNCTION__, __LINE__, errno);
+            handleWriteError(savedErrno);
         }
     }
     else
@@ -105,6 +238,118 @@ void TcpConnection::handleWrite()
     }
 }
 
+// 对端已经断开(EPIPE/ECONNRESET)或者读文件出错，剩下的数据无法再按顺序发送，关闭连接
+// 在回调队列中关闭，调用者(比如messageCallback中的sendFile)返回之后才执行关闭回调
+void TcpConnection::handleWriteError(int savedErrno)
+{
+    if (savedErrno == EINTR)
+    { // 等下一次可写事件重试
+        return;
+    }
+    LOG_ERROR("%s:%s:%d   TcpConnection::handleWriteError [%s] errno %d\n"
+            , __FILE__, __FUNCTION__, __LINE__, name_.c_str(), savedErrno);
+    handleError();
+    channel_->disableWriting();
+    forceClose();
+}
+
+void TcpConnection::notifyWaiter(ConnectionAwaiter *&waiter)
+{
+    if (waiter != nullptr && waiter->ready())
+    { // 先清空，协程恢复之后可能马上又开始等待
+        ConnectionAwaiter *ready = waiter;
+        waiter = nullptr;
+        ready->wake();
+    }
+}
+
+void TcpConnection::cancelWaiters()
+{
+    if (readWaiter_ != nullptr)
+    {
+        ConnectionAwaiter *waiter = readWaiter_;
+        readWaiter_ = nullptr;
+        waiter->wake();
+    }
+    if (writeWaiter_ != nullptr)
+    {
+        ConnectionAwaiter *waiter = writeWaiter_;
+        writeWaiter_ = nullptr;
+        waiter->wake();
+    }
+}
+
+// 没有任何待发送的数据
+bool TcpConnection::outputIdle() const
+{
+    return !channel_->isWriteing() && outputBuffer_.readableBytes() == 0 && outputRegions_.empty();
+}
+
+// 按顺序发送：先写文件区间前面的outputBuffer_数据，再sendfile文件区间，直到socket写满
+bool TcpConnection::writeOutput(int *savedErrno)
+{
+    for (;;)
+    {
+        if (!outputRegions_.empty() && outputRegions_.front().bytesBefore == 0)
+        { // 区间前面的数据已经写完，发送文件或者零拷贝数据
+            OutputRegion &region = outputRegions_.front();
+            ssize_t n = region.payload ? sendZeroCopy(region.payload, region.offset, region.remaining)
+                                       : ::sendfile(channel_->fd(), region.fd, &region.offset, region.remaining);
+            if (n < 0)
+            {
+                if (errno == EWOULDBLOCK)
+                {
+                    return true;
+                }
+                *savedErrno = errno;
+                return false;
+            }
+            if (n == 0 && !region.payload)
+            { // 文件被截断，剩下的部分放弃发送
+                LOG_ERROR("%s:%s:%d   TcpConnection::writeOutput file fd=%d truncated\n"
+                        , __FILE__, __FUNCTION__, __LINE__, region.fd);
+                region.remaining = 0;
+            }
+            else
+            {
+                if (region.payload)
+                {
+                    region.offset += n;
+                }
+                region.remaining -= n;
+            }
+            if (region.remaining > 0)
+            { // socket已经写满
+                return true;
+            }
+            outputRegions_.pop_front();
+            continue;
+        }
+
+        // 有文件区间时只能写到文件区间之前
+        size_t limit = outputRegions_.empty() ? outputBuffer_.readableBytes() : outputRegions_.front().bytesBefore;
+        if (limit == 0)
+        {
+            return true;
+        }
+        ssize_t n = outputBuffer_.writeFd(channel_->fd(), savedErrno, limit);
+        if (n < 0)
+        {
+            return *savedErrno == EWOULDBLOCK;
+        }
+        outputBuffer_.retrieve(n); // 调整readIndex_的位置
+        if (!outputRegions_.empty())
+        {
+            outputRegions_.front().bytesBefore -= n;
+            regionBufferBytes_ -= n;
+        }
+        if (static_cast<size_t>(n) < limit)
+        { // socket已经写满
+            return true;
+        }
+    }
+}
+
 // 关闭连接的回调
 void TcpConnection::handleClose()
 {
@@ -112,8 +357,13 @@ void TcpConnection::handleClose()
             , __FILE__, __FUNCTION__, __LINE__, channel_->fd(), (int)state_);
     setState(KDisconnected); // 设置连接状态为已关闭
     channel_->disableAll();  // 取消对关注的所有事件
+    if (idleWheel_)
+    { // 已经关闭的连接不再检测是否空闲
+        idleWheel_->remove(&idleEntry_);
+    }
 
     TcpConnectionPtr connPtr(shared_from_this());
+    cancelWaiters();
     if (connectionCallback_)
     {
         connectionCallback_(connPtr); // 执行关闭连接的回调
@@ -127,6 +377,12 @@ void TcpConnection::handleClose()
 // 处理错误的回调
 void TcpConnection::handleError()
 {
+    // 开启零拷贝后，错误队列中的完成通知也会触发EPOLLERR
+    if (zeroCopy_ && handleZeroCopyCompletions() > 0)
+    {
+        return;
+    }
+
     int optval = 0;
     socklen_t optlen = sizeof optval;
     int err = 0;
@@ -143,23 +399,382 @@ void TcpConnection::handleError()
                 , __FILE__, __FUNCTION__, __LINE__, name_.c_str(), err);
 }
 
+// 读取错误队列中所有的零拷贝完成通知，释放内核已经用完的数据
+int TcpConnection::handleZeroCopyCompletions()
+{
+    int count = 0;
+    for (;;)
+    {
+        char control[128];
+        msghdr msg;
+        bzero(&msg, sizeof msg);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        if (::recvmsg(channel_->fd(), &msg, MSG_ERRQUEUE) < 0)
+        { // EAGAIN 错误队列已经读完
+            break;
+        }
+        for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+            {
+                continue;
+            }
+            sock_extended_err *serr = reinterpret_cast<sock_extended_err *>(CMSG_DATA(cm));
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+            // [ee_info, ee_data]是这次完成的sendmsg序号区间
+            uint32_t lo = serr->ee_info;
+            uint32_t hi = serr->ee_data;
+            uint32_t n = hi - lo + 1;
+            zeroCopyStats_.completions += n;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                zeroCopyStats_.copied += n;
+            }
+            // 完成通知按序号顺序到达，序号不大于hi的数据都可以释放了
+            while (!zeroCopyPending_.empty() &&
+                   static_cast<int32_t>(zeroCopyPending_.front().id - hi) <= 0)
+            {
+                zeroCopyPending_.pop_front();
+            }
+            ++count;
+        }
+    }
+    return count;
+}
+
+void TcpConnection::setZeroCopy(bool on, size_t threshold)
+{
+    if (on && !socket_->setZeroCopy(true))
+    {
+        LOG_ERROR("%s:%s:%d   TcpConnection::setZeroCopy [%s] SO_ZEROCOPY not supported errno %d\n"
+                , __FILE__, __FUNCTION__, __LINE__, name_.c_str(), errno);
+        return;
+    }
+    zeroCopy_ = on;
+    zeroCopyThreshold_ = threshold;
+}
+
+void TcpConnection::setBusyPoll(int usec)
+{
+    if (!socket_->setBusyPoll(usec, true))
+    {
+        LOG_ERROR("%s:%s:%d   TcpConnection::setBusyPoll [%s] errno %d\n"
+                , __FILE__, __FUNCTION__, __LINE__, name_.c_str(), errno);
+    }
+}
+
 void TcpConnection::send(const std::string &buf)
+{
+    send(buf.data(), buf.size());
+}
+
+void TcpConnection::send(const void *data, size_t len)
+{
+    iovec vec;
+    vec.iov_base = const_cast<void *>(data);
+    vec.iov_len = len;
+    send(&vec, 1);
+}
+
+void TcpConnection::send(const iovec *iov, int iovcnt)
 {
     if (state_ == KConnected)
     { // 已连接状态才可以可以发送数据
         if (loop_->isInLoopThread())
         { // 当前loop所属当前thread
-            sendInLoop(buf.c_str(), buf.size());
+            sendInLoop(iov, iovcnt);
+        }
+        else
+        { // 当前loop不属于当前线程，数据片拷贝成一个string后交给loop所属线程发送
+            OutboundMessage message;
+            for (int i = 0; i < iovcnt; ++i)
+            {
+                message.str.append(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+            }
+            queueOutbound(std::move(message));
+        }
+    }
+}
+
+void TcpConnection::send(Buffer *buf)
+{
+    if (state_ == KConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendInLoop(buf);
+        }
+        else
+        {
+            OutboundMessage message;
+            message.str = buf->retrieveAllAsString();
+            queueOutbound(std::move(message));
+        }
+    }
+}
+
+void TcpConnection::send(std::string &&buf)
+{
+    if (state_ == KConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendStringInLoop(buf);
+        }
+        else
+        {
+            OutboundMessage message;
+            message.str = std::move(buf);
+            queueOutbound(std::move(message));
+        }
+    }
+}
+
+void TcpConnection::send(std::unique_ptr<Buffer> buf)
+{
+    if (state_ == KConnected && buf)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendInLoop(buf.get());
+        }
+        else
+        {
+            OutboundMessage message;
+            message.buf = std::move(buf);
+            queueOutbound(std::move(message));
+        }
+    }
+}
+
+void TcpConnection::send(const SharedPayload &payload)
+{
+    if (state_ == KConnected && payload)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendPayloadInLoop(payload);
+        }
+        else
+        {
+            OutboundMessage message;
+            message.payload = payload;
+            queueOutbound(std::move(message));
+        }
+    }
+}
+
+bool TcpConnection::sendFile(int fd, off_t offset, size_t len)
+{
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || offset < 0 ||
+        static_cast<uint64_t>(offset) + len > static_cast<uint64_t>(st.st_size))
+    {
+        LOG_ERROR("%s:%s:%d   TcpConnection::sendFile [%s] invalid file fd=%d offset=%ld len=%lu\n"
+                , __FILE__, __FUNCTION__, __LINE__, name_.c_str(), fd, static_cast<long>(offset), len);
+        return false;
+    }
+    if (state_ != KConnected)
+    {
+        return false;
+    }
+    if (len > 0)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendFileInLoop(fd, offset, len);
+        }
+        else
+        { // 和其他线程send的数据走同一个队列，保证先后顺序
+            OutboundMessage message;
+            message.fileFd = fd;
+            message.fileOffset = offset;
+            message.fileLen = len;
+            queueOutbound(std::move(message));
         }
     }
+    return true;
+}
+
+// 其他线程发送的数据放入队列，N次send只需要一次唤醒
+void TcpConnection::queueOutbound(OutboundMessage &&message)
+{
+    bool needFlush = false;
+    {
+        std::unique_lock<std::mutex> lock(outboundMutex_);
+        // 队列由空变为非空时说明loop还没有安排flushOutbound
+        needFlush = outbound_.empty();
+        outbound_.push_back(std::move(message));
+    }
+    if (needFlush)
+    {
+        loop_->queueINLoop(std::bind(&TcpConnection::flushOutbound, shared_from_this()));
+    }
+}
+
+// 在loop线程中按顺序发送其他线程交过来的数据
+void TcpConnection::flushOutbound()
+{
+    {
+        std::unique_lock<std::mutex> lock(outboundMutex_);
+        outboundFlushing_.swap(outbound_);
+    }
+    for (OutboundMessage &message : outboundFlushing_)
+    {
+        if (message.fileFd >= 0)
+        {
+            sendFileInLoop(message.fileFd, message.fileOffset, message.fileLen);
+        }
+        else if (message.buf)
+        {
+            sendInLoop(message.buf.get());
+        }
+        else if (message.payload)
+        {
+            sendPayloadInLoop(message.payload);
+        }
+        else
+        {
+            sendStringInLoop(message.str);
+        }
+    }
+    outboundFlushing_.clear();
+}
+
+void TcpConnection::queueWriteComplete()
+{
+    TcpConnectionPtr conn(shared_from_this());
+    loop_->queueINLoop([conn]() { conn->writeCompleteCallback_(conn); });
+}
+
+void TcpConnection::queueHighWaterMark(size_t len)
+{
+    TcpConnectionPtr conn(shared_from_this());
+    loop_->queueINLoop([conn, len]() { conn->highWaterMarkCallback_(conn, len); });
+}
+
+// 数据的所有权已经交给了连接，较大的数据可以转成SharedPayload零拷贝发送
+void TcpConnection::sendStringInLoop(std::string &message)
+{
+    if (zeroCopy_ && message.size() >= zeroCopyThreshold_)
+    {
+        sendZeroCopyInLoop(std::make_shared<const std::string>(std::move(message)));
+    }
+    else
+    {
+        sendInLoop(message.data(), message.size());
+    }
+}
+
+void TcpConnection::sendPayloadInLoop(const SharedPayload &payload)
+{
+    if (zeroCopy_ && payload->size() >= zeroCopyThreshold_)
+    {
+        sendZeroCopyInLoop(payload);
+    }
     else
-    { // 当前loop不属于当前线程，需要注册回调，让loop所属线程调用
-        loop_->runInLoop(std::bind(&TcpConnection::sendInLoop, this, buf.c_str(), buf.size()));
+    {
+        sendInLoop(payload->data(), payload->size());
     }
 }
 
+// 零拷贝发送payload，没发完的部分作为区间排在outputBuffer_现有数据的后面
+void TcpConnection::sendZeroCopyInLoop(const SharedPayload &payload)
+{
+    if (state_ == KDisconnected)
+    {
+        LOG_INFO("%s:%s:%d   TcpConnection::sendZeroCopyInLoop disconnected give up writing"
+                , __FILE__, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    OutputRegion region;
+    region.bytesBefore = outputBuffer_.readableBytes() - regionBufferBytes_;
+    region.fd = -1;
+    region.offset = 0;
+    region.remaining = payload->size();
+    region.payload = payload;
+
+    if (outputIdle())
+    {
+        ssize_t n = sendZeroCopy(payload, 0, payload->size());
+        if (n >= 0)
+        {
+            region.offset += n;
+            region.remaining -= n;
+            if (region.remaining == 0 && writeCompleteCallback_)
+            {
+                queueWriteComplete();
+            }
+        }
+        else if (errno != EWOULDBLOCK && errno != EINTR)
+        { // 和sendFileInLoop一样，出错直接关闭连接，不能留下一段没有发送的数据
+            handleWriteError(errno);
+            return;
+        }
+    }
+
+    if (region.remaining > 0)
+    {
+        regionBufferBytes_ += region.bytesBefore;
+        outputRegions_.push_back(region);
+        if (!channel_->isWriteing())
+        {
+            channel_->enableWriting();
+        }
+    }
+}
+
+// 使用MSG_ZEROCOPY发送，发送成功的payload保存到收到完成通知为止
+ssize_t TcpConnection::sendZeroCopy(const SharedPayload &payload, off_t offset, size_t len)
+{
+    const char *data = payload->data() + offset;
+    iovec vec;
+    vec.iov_base = const_cast<char *>(data);
+    vec.iov_len = len;
+    msghdr msg;
+    bzero(&msg, sizeof msg);
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+
+    ssize_t n = ::sendmsg(channel_->fd(), &msg, MSG_ZEROCOPY);
+    if (n >= 0)
+    {
+        // 每一次成功的MSG_ZEROCOPY发送都对应内核中的一个序号
+        ZeroCopyPending pending;
+        pending.id = zeroCopyNextId_++;
+        pending.payload = payload;
+        zeroCopyPending_.push_back(std::move(pending));
+        ++zeroCopyStats_.sends;
+    }
+    else if (errno == ENOBUFS)
+    { // 超过了optmem的限制，这次改用普通的write拷贝发送
+        ++zeroCopyStats_.fallbacks;
+        n = ::write(channel_->fd(), data, len);
+    }
+    return n;
+}
+
 void TcpConnection::sendInLoop(const void *data, size_t len)
 {
+    iovec vec;
+    vec.iov_base = const_cast<void *>(data);
+    vec.iov_len = len;
+    sendInLoop(&vec, 1);
+}
+
+void TcpConnection::sendInLoop(const iovec *iov, int iovcnt)
+{
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i)
+    {
+        len += iov[i].iov_len;
+    }
     ssize_t nwrote = 0;
     size_t remaining = len; // 表示还未写的数据长度
     bool faultError = false;
@@ -170,15 +785,17 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
         return;
     }
 
-    if (!channel_->isWriteing() && outputBuffer_.readableBytes() == 0)
+    if (outputIdle())
     { // fd不关注写事件 并且 outputBuffer_缓冲区中的可读的数据为0
-        nwrote = ::write(channel_->fd(), data, len);
+        // 多个数据片使用writev一次写出
+        nwrote = iovcnt == 1 ? ::write(channel_->fd(), iov[0].iov_base, len)
+                             : writeIovec(iov, iovcnt);
         if (nwrote >= 0)
         {
             remaining = len - nwrote;
             if (remaining == 0 && writeCompleteCallback_)
             { // 表示数据已经发生完成,注册写完成的回调函数
-                loop_->queueINLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                queueWriteComplete();
             }
         }
         else // nwrote < 0 出错
@@ -204,10 +821,20 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
 
         if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
         {
-            loop_->queueINLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+            queueHighWaterMark(oldLen + remaining);
+        }
+        // 跳过已经写出的部分，将没写完的数据片逐个追加到outbuffer_缓冲区中
+        size_t skip = nwrote;
+        for (int i = 0; i < iovcnt; ++i)
+        {
+            if (skip >= iov[i].iov_len)
+            {
+                skip -= iov[i].iov_len;
+                continue;
+            }
+            outputBuffer_.append(static_cast<const char *>(iov[i].iov_base) + skip, iov[i].iov_len - skip);
+            skip = 0;
         }
-        // 将为写完的数据先写入到outbuffer_缓冲区中
-        outputBuffer_.append((char *)data + nwrote, remaining);
 
         if (!channel_->isWriteing())
         { // 如果fd未关注写事件，让fd关注写事件
@@ -216,6 +843,131 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     }
 }
 
+// 每次writev最多IOV_MAX个数据片，一直写到全部写完或者socket写满
+// 这样写出的比len少就说明socket已经写满，边沿触发模式可以放心地等待可写事件
+ssize_t TcpConnection::writeIovec(const iovec *iov, int iovcnt)
+{
+    ssize_t written = 0;
+    while (iovcnt > 0)
+    {
+        int cnt = std::min(iovcnt, IOV_MAX);
+        size_t batch = 0;
+        for (int i = 0; i < cnt; ++i)
+        {
+            batch += iov[i].iov_len;
+        }
+        ssize_t n = ::writev(channel_->fd(), iov, cnt);
+        if (n < 0)
+        {
+            return written > 0 ? written : n;
+        }
+        written += n;
+        if (static_cast<size_t>(n) < batch)
+        {
+            break;
+        }
+        iov += cnt;
+        iovcnt -= cnt;
+    }
+    return written;
+}
+
+void TcpConnection::sendInLoop(Buffer *buf)
+{
+    if (state_ == KDisconnected)
+    {
+        LOG_INFO("%s:%s:%d   TcpConnection::sennInLoop disconnected give up writing"
+                , __FILE__, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    bool faultError = false;
+    if (outputIdle())
+    { // 没有待发送的数据，直接writev
+        int savedErrno = 0;
+        ssize_t nwrote = buf->writeFd(channel_->fd(), &savedErrno);
+        if (nwrote >= 0)
+        {
+            buf->retrieve(nwrote);
+            if (buf->readableBytes() == 0 && writeCompleteCallback_)
+            {
+                queueWriteComplete();
+            }
+        }
+        else if (savedErrno != EWOULDBLOCK)
+        {
+            LOG_ERROR("%s:%s:%d   Tcpconnection::sendInLoop write errno\n"
+                    , __FILE__, __FUNCTION__, __LINE__);
+            if (savedErrno == EPIPE || savedErrno == ECONNRESET)
+            {
+                faultError = true;
+            }
+        }
+    }
+
+    size_t remaining = buf->readableBytes();
+    if (!faultError && remaining > 0)
+    {
+        size_t oldLen = outputBuffer_.readableBytes();
+        if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
+        {
+            queueHighWaterMark(oldLen + remaining);
+        }
+        // 分段的buf直接把块移到outbuffer_中
+        outputBuffer_.append(std::move(*buf));
+
+        if (!channel_->isWriteing())
+        {
+            channel_->enableWriting();
+        }
+    }
+    buf->retrieveAll();
+}
+
+void TcpConnection::sendFileInLoop(int fd, off_t offset, size_t len)
+{
+    if (state_ == KDisconnected)
+    {
+        LOG_INFO("%s:%s:%d   TcpConnection::sendFileInLoop disconnected give up writing"
+                , __FILE__, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    OutputRegion region;
+    region.bytesBefore = outputBuffer_.readableBytes() - regionBufferBytes_;
+    region.fd = fd;
+    region.offset = offset;
+    region.remaining = len;
+
+    if (outputIdle())
+    { // 前面没有待发送的数据，直接sendfile
+        ssize_t n = ::sendfile(channel_->fd(), fd, &region.offset, len);
+        if (n >= 0)
+        {
+            region.remaining -= n;
+            if (region.remaining == 0 && writeCompleteCallback_)
+            {
+                queueWriteComplete();
+            }
+        }
+        else if (errno != EWOULDBLOCK && errno != EINTR)
+        {
+            handleWriteError(errno);
+            return;
+        }
+    }
+
+    if (region.remaining > 0)
+    { // 文件没有发完，排到outputBuffer_现有数据的后面，等可写事件再发送
+        regionBufferBytes_ += region.bytesBefore;
+        outputRegions_.push_back(region);
+        if (!channel_->isWriteing())
+        {
+            channel_->enableWriting();
+        }
+    }
+}
+
 void TcpConnection::shutdown()
 {
     if (state_ == KConnected)
@@ -234,6 +986,23 @@ void TcpConnection::shutdownInLoop()
     }
 }
 
+void TcpConnection::forceClose()
+{
+    if (state_ == KConnected || state_ == KDisconnecting)
+    {
+        setState(KDisconnecting);
+        loop_->queueINLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (state_ == KConnected || state_ == KDisconnecting)
+    { // 和对端关闭连接一样处理
+        handleClose();
+    }
+}
+
 // 建立连接
 void TcpConnection::connectEstablished()
 {
@@ -242,7 +1011,19 @@ void TcpConnection::connectEstablished()
     // channel_监听TcpConnection是否存在 tie就是将当前TcpConnection给Channel让Channel监听着
     // 因为channel中调用的回调都是来自TcpConnection的
     channel_->tie(shared_from_this());
-    channel_->enableReading(); // fd关注写事件
+    if (edgeTriggered_ && loop_->edgeTriggeredSupported())
+    { // 读写事件一次注册
+        channel_->enableEdgeTriggered();
+    }
+    else
+    {
+        channel_->enableReading(); // fd关注读事件
+    }
+    if (idleWheel_)
+    { // 挂到所属loop的时间轮上检测空闲
+        idleEntry_.context = this;
+        idleWheel_->add(&idleEntry_);
+    }
 
     // 调用新连接的回调
     connectionCallback_(shared_from_this());
@@ -261,6 +1042,11 @@ void TcpConnection::connectDestroyed()
         // 调用关闭连接的回调函数->这个是用户传递的一个回调或者默认的
         connectionCallback_(shared_from_this());
     }
+    cancelWaiters();
+    if (idleWheel_)
+    {
+        idleWheel_->remove(&idleEntry_);
+    }
     // 将channel从EventLoop中删除
     // 并且将这个fd从epoll内核事件表中删除
     channel_->remove(); 
@@ -1,13 +1,21 @@
 #pragma once
+#include "Awaiter.h"
 #include "Buffer.h"
 #include "Callbacks.h"
 #include "InetAddress.h"
 #include "noncopyable.h"
 #include "Timestamp.h"
+#include "TimingWheel.h"
 
 #include <atomic>
+#include <deque>
+#include <stdint.h>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
 
 class Channel;
 class EventLoop;
@@ -17,6 +25,21 @@ class TcpConnection : noncpoyable, public std::enable_shared_from_this<TcpConnec
 {
 
 public:
+    // 引用计数的发送数据，同一份数据可以发给多个连接
+    using SharedPayload = std::shared_ptr<const std::string>;
+
+    // 零拷贝发送的统计
+    struct ZeroCopyStats
+    {
+        uint64_t sends;       // 使用MSG_ZEROCOPY的sendmsg次数
+        uint64_t completions; // 收到的完成通知个数
+        uint64_t copied;      // 内核实际上还是拷贝了数据的次数
+        uint64_t fallbacks;   // 内核拒绝零拷贝(ENOBUFS)改用普通write的次数
+    };
+
+    // 默认超过这个大小的数据才使用零拷贝
+    static const size_t KDefaultZeroCopyThreshold = 64 * 1024;
+
     TcpConnection(EventLoop *loop,
                  const std::string &nameArg, 
                  int sockfd, 
@@ -26,14 +49,65 @@ public:
 
     EventLoop *getLoop() const { return loop_; }
     const std::string &name() const { return name_; }
-    const InetAddress &localAddress() const { return localAddr_; }
+    // 监听的是通配地址(0.0.0.0)时，第一次调用才用getsockname取得实际的本地地址，只在loop线程中调用
+    const InetAddress &localAddress() const;
     const InetAddress &peerAddress() const { return peerAddr_; }
 
     bool connected() const { return state_ == KConnected; }
     bool disconnected() const { return state_ == KDisconnected; }
 
     void send(const std::string &buf);
+    void send(const void *data, size_t len);
+    // 分散发送多个数据片(比如header + body + trailer)，不需要先拼接成一个字符串
+    void send(const iovec *iov, int iovcnt);
+    // 发送buf中所有可读的数据，并清空buf
+    void send(Buffer *buf);
+
+    // 以下几个send会转移数据的所有权，其他线程调用时数据直接移交给loop线程，不会拷贝
+    void send(std::string &&buf);
+    void send(std::unique_ptr<Buffer> buf);
+    void send(const SharedPayload &payload);
+
+    // 发送文件fd中从offset开始的len字节，在可写时用sendfile从内核直接发送
+    // 和其他send的数据保持先后顺序，fd由调用者管理，在writeCompleteCallback之前不能关闭
+    // fd不是普通文件、区间超出文件大小或者连接已经断开时返回false，不发送任何数据
+    // 发送过程中出错(对端重置、读文件出错)时关闭连接，后面的数据已经无法按顺序发送
+    bool sendFile(int fd, off_t offset, size_t len);
+
+    // 开启零拷贝发送，只在loop线程中调用(比如连接建立的回调中)
+    // 开启后send(std::string&&)和send(SharedPayload)发送不小于threshold的数据时使用MSG_ZEROCOPY，
+    // 数据一直保存到内核通过错误队列通知发送完成
+    void setZeroCopy(bool on, size_t threshold = KDefaultZeroCopyThreshold);
+    bool zeroCopy() const { return zeroCopy_; }
+    // 只在loop线程中读取
+    const ZeroCopyStats &zeroCopyStats() const { return zeroCopyStats_; }
     void shutdown();
+    // 强制关闭连接，不等待数据发送完
+    void forceClose();
+
+    // 使用边沿触发，在connectEstablished之前调用，poller不支持时仍然使用水平触发
+    // 读事件到来时一直读到socket中没有数据，写事件一次注册，之后发送数据不再调用epoll_ctl
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+
+    // 在socket上开启内核的busy poll(SO_BUSY_POLL/SO_PREFER_BUSY_POLL)，usec为内核忙等数据的时长
+    void setBusyPoll(int usec);
+
+    // 暂停/恢复读取socket上的数据，暂停期间数据留在内核缓冲区中，由TCP的流量控制让对端放慢发送
+    // 可以在任意线程调用
+    void startRead();
+    void stopRead();
+    // 只在loop线程中调用
+    bool isReading() const { return reading_; }
+
+    // 连接上提交给ComputePool、还没有完成的任务个数，只在loop线程中访问
+    int outstandingJobs() const { return outstandingJobs_; }
+    void setOutstandingJobs(int n) { outstandingJobs_ = n; }
+    // 是否是ComputePool因为任务太多停止读的，只有这种情况任务完成后才由线程池恢复读
+    bool computeThrottled() const { return computeThrottled_; }
+    void setComputeThrottled(bool on) { computeThrottled_ = on; }
+
+    // 设置检测空闲连接的时间轮，在connectEstablished之前调用
+    void setIdleWheel(const std::shared_ptr<TimingWheel> &wheel) { idleWheel_ = wheel; }
 
     // 设置回调
     void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = std::move(cb); }
@@ -43,8 +117,33 @@ public:
     void setCloseCallback(const CloseCallback &cb) { closeCallback_ = std::move(cb); }
 
     Buffer *inputBuffer() { return &inputBuffer_; }
+    const Buffer *inputBuffer() const { return &inputBuffer_; }
     Buffer *outputBuffer() { return &outputBuffer_; }
 
+    // 没有任何待发送的数据(不包括其他线程还没有交给loop的数据)
+    bool outputIdle() const;
+
+    // 协程接口(见Awaiter.h/Coroutine.h)，只能在loop线程中co_await
+    // 比如 if (co_await conn->readAtLeast(4)) {...}
+    ReadAtLeastAwaiter readAtLeast(size_t n) { return ReadAtLeastAwaiter(this, n); }
+    ReadUntilAwaiter readUntil(const std::string &delim) { return ReadUntilAwaiter(this, delim); }
+    FlushAwaiter flush() { return FlushAwaiter(this); }
+    // awaiter使用，条件满足或者连接断开时恢复挂起的协程，nullptr表示没有协程在等待
+    void setReadWaiter(ConnectionAwaiter *waiter) { readWaiter_ = waiter; }
+    void setWriteWaiter(ConnectionAwaiter *waiter) { writeWaiter_ = waiter; }
+    // 挂起的协程被销毁，不再恢复它
+    void clearWaiter(ConnectionAwaiter *waiter)
+    {
+        if (readWaiter_ == waiter)
+        {
+            readWaiter_ = nullptr;
+        }
+        if (writeWaiter_ == waiter)
+        {
+            writeWaiter_ = nullptr;
+        }
+    }
+
     // 建立连接
     void connectEstablished();
     // 销毁连接
@@ -60,23 +159,88 @@ private:
     };
 
     void handleRead(Timestamp receiveTime);
+    void continueRead();
     void handleWrite();
     void handleClose();
     void handleError();
     
+    // 其他线程交给loop线程发送的数据，三种数据只有一种不为空
+    struct OutboundMessage
+    {
+        std::string str;
+        std::unique_ptr<Buffer> buf;
+        SharedPayload payload;
+        int fileFd = -1;
+        off_t fileOffset = 0;
+        size_t fileLen = 0;
+    };
+
+    // 排在outputBuffer_数据之间等待发送的区间：
+    // payload为空时是sendfile发送的文件区间，否则是零拷贝发送的数据，offset为已发送的位置
+    struct OutputRegion
+    {
+        size_t bytesBefore; // 和前一个区间之间还在outputBuffer_中的数据长度
+        int fd;
+        off_t offset;
+        size_t remaining;
+        SharedPayload payload;
+    };
+
+    // 已经交给内核零拷贝发送、等待完成通知的数据
+    struct ZeroCopyPending
+    {
+        uint32_t id;
+        SharedPayload payload;
+    };
+
     void sendInLoop(const void*message,size_t len);
+    void sendInLoop(const iovec *iov, int iovcnt);
+    // writev发送多个数据片，数据片超过IOV_MAX时分多次写
+    ssize_t writeIovec(const iovec *iov, int iovcnt);
+    // 发送buf中的数据，没写完的部分移到outputBuffer_中
+    void sendInLoop(Buffer *buf);
+    void sendFileInLoop(int fd, off_t offset, size_t len);
+    // 写socket或者sendfile出错，关闭连接
+    void handleWriteError(int savedErrno);
+    // 转移所有权的数据在这里决定是否使用零拷贝发送
+    void sendStringInLoop(std::string &message);
+    void sendPayloadInLoop(const SharedPayload &payload);
+    void sendZeroCopyInLoop(const SharedPayload &payload);
+    // 用MSG_ZEROCOPY发送payload中从offset开始的len字节
+    ssize_t sendZeroCopy(const SharedPayload &payload, off_t offset, size_t len);
+    // 读取错误队列中的零拷贝完成通知，返回读到的通知个数
+    int handleZeroCopyCompletions();
+    // 按顺序把outputBuffer_和文件区间写到socket上，返回false表示出错
+    bool writeOutput(int *savedErrno);
+    // 其他线程调用send时，数据放入outbound_队列，只有队列由空变为非空时才唤醒loop
+    void queueOutbound(OutboundMessage &&message);
+    // loop线程一次发送outbound_中的所有数据
+    void flushOutbound();
+    // 把用户回调放到loop的队列中执行，只捕获TcpConnectionPtr，不拷贝std::function
+    void queueWriteComplete();
+    void queueHighWaterMark(size_t len);
     void shutdownInLoop();
+    void forceCloseInLoop();
+    void startReadInLoop();
+    void stopReadInLoop();
 
     void setState(StateE s){ state_ = s;}
+    // 条件满足时恢复waiter对应的协程
+    static void notifyWaiter(ConnectionAwaiter *&waiter);
+    // 连接断开，恢复所有挂起的协程
+    void cancelWaiters();
 
     EventLoop *loop_;
     const std::string name_;
     std::atomic_int state_;
     bool reading_;
+    bool edgeTriggered_;
+    int outstandingJobs_;
+    bool computeThrottled_;
 
     std::unique_ptr<Socket> socket_;    
     std::unique_ptr<Channel> channel_;
-    const InetAddress localAddr_;
+    mutable InetAddress localAddr_;
     const InetAddress peerAddr_;
 
     ConnectionCallback connectionCallback_;
@@ -84,8 +248,31 @@ private:
     WriteCompleteCallback writeCompleteCallback_;
     CloseCallback closeCallback_;
     HighWaterMarkCallback highWaterMarkCallback_;
+    ConnectionAwaiter *readWaiter_;  // 等待读条件的协程
+    ConnectionAwaiter *writeWaiter_; // 等待发送完的协程
     size_t highWaterMark_;
 
     Buffer inputBuffer_;   // 接收数据的缓冲区
-    Buffer outputBuffer_;  // 发送数据的缓冲区
+    Buffer outputBuffer_;  // 发送数据的缓冲区(分段模式)
+
+    // 排在outputBuffer_数据之间等待发送的区间
+    std::deque<OutputRegion> outputRegions_;
+    // 所有区间的bytesBefore之和
+    size_t regionBufferBytes_;
+
+    // 空闲连接检测，handleRead/handleWrite只在idleEntry_上记录一下当前的tick
+    std::shared_ptr<TimingWheel> idleWheel_;
+    TimingWheel::Entry idleEntry_;
+
+    bool zeroCopy_;
+    size_t zeroCopyThreshold_;
+    uint32_t zeroCopyNextId_; // 下一次MSG_ZEROCOPY发送的序号，和内核的计数一致
+    std::deque<ZeroCopyPending> zeroCopyPending_;
+    ZeroCopyStats zeroCopyStats_;
+
+    // 其他线程发送的数据队列(多生产者单消费者)
+    std::mutex outboundMutex_;
+    std::vector<OutboundMessage> outbound_;
+    // loop线程交换出来待发送的数据，复用vector的内存
+    std::vector<OutboundMessage> outboundFlushing_;
 };
@@ -1,5 +1,12 @@
 #include "TcpServer.h"
+#include <errno.h>
 #include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49 // linux 3.19
+#endif
 
 // 检测baseloop是否为空，如果为空程序直接退出
 static EventLoop *checkNotNull(EventLoop *loop)
@@ -14,23 +21,81 @@ static EventLoop *checkNotNull(EventLoop *loop)
 TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string nameArg,
                      Option option)
     : loop_(checkNotNull(loop)) // 用户传递的主loop baseloop
+    , listenAddr_(listenAddr)
+    , option_(option)
     , ipPort_(listenAddr.toIpPort()) // 用户传递的listenfd的地址(服务器的ip和port)
     , name_(nameArg) // 用户传递的服务器名
-    , acceptor_(new Acceptor(loop, listenAddr, option == KReusePort)) // 创建listenfd对应的Acceptor
+    , connNamePrefix_(name_ + "-" + ipPort_ + "#")
+    // 创建listenfd对应的Acceptor，KReusePortPerLoop模式下每个subloop在start时创建自己的socket，不需要mainloop的
+    , acceptor_(option == KReusePortPerLoop ? nullptr : new Acceptor(loop, listenAddr, option == KReusePort))
+    , reusePortCpuSteering_(false)
     , threadPool_(new EventLoopThreadPool(loop, name_)) // 创建Eventloop线程池
     , connectionCallback_() // 新连接到来的回调
     , messageCallback_() // 已连接数据到来的回调
     , nextConnId_(1)
     , started_(0)
+    , idleTimeoutSeconds_(0)
+    , edgeTriggered_(false)
+    , busyPollUs_(0)
+    , socketBusyPollUs_(0)
+    , maxReadBytesPerIteration_(0)
+    , maxFunctorsPerIteration_(0)
+    , incomingCpuDispatch_(false)
+    , numConnections_(0)
+    , maxConnections_(0)
+    , acceptPauseSeconds_(Acceptor::KDefaultOverloadPauseSeconds)
+    , accepted_(0)
+    , rejectedMaxConnections_(0)
+    , rejectedRateLimit_(0)
+    , stopping_(false)
+    , stallThresholdMs_(0)
+{
+    if (acceptor_)
+    {
+        // 给Acceptor设置的处理新的连接的回调函数TcpServer::newConnection
+        acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2));
+        acceptor_->setAcceptBatchCallback(std::bind(&TcpServer::dispatchPendingConnections, this));
+    }
+}
+
+// 最后处理这个连接数据包的CPU，不支持时返回-1
+static int incomingCpu(int sockfd)
 {
-    // 给Acceptor设置的处理新的连接的回调函数TcpServer::newConnection
-    acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2));
+    int cpu = -1;
+    socklen_t len = sizeof cpu;
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0)
+    {
+        return -1;
+    }
+    return cpu;
+}
+
+// 时间轮上超时的连接，强制关闭
+static void onIdleExpired(TimingWheel::Entry *entry)
+{
+    TcpConnection *conn = static_cast<TcpConnection *>(entry->context);
+    LOG_INFO("%s:%s:%d   TcpServer idle connection [%s] timeout\n", __FILE__, __FUNCTION__, __LINE__, conn->name().c_str());
+    conn->forceClose();
 }
 
 TcpServer::~TcpServer()
 {
     LOG_INFO("%s:%s:%d   TcpServer::~TcpServer [%s] destructing\n", __FILE__, __FUNCTION__, __LINE__, name_.c_str());
-    for (auto &item : connections_)
+    for (auto &item : idleWheels_)
+    { // 停止各个loop上的时间轮
+        item.first->runInLoop(std::bind(&TimingWheel::stop, item.second));
+    }
+    for (std::shared_ptr<Acceptor> &acceptor : loopAcceptors_)
+    { // 把acceptor交给所属的loop，在loop线程中执行完回调后析构
+        EventLoop *ioLoop = acceptor->ownerLoop();
+        ioLoop->runInLoop(std::bind(&Acceptor::stop, std::move(acceptor)));
+    }
+    ConnectionMap connections;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex_);
+        connections.swap(connections_);
+    }
+    for (auto &item : connections)
     {
         // 使用一个局部的TcpConnectionPtr接收
         TcpConnectionPtr conn(item.second);
@@ -55,54 +120,354 @@ void TcpServer::start()
     {
         // 启动EventLoop线程池(创建用户设置的数量个线程)
         threadPool_->start(threadInitCallback_);
-        // 调用runInloop->Acceeptor::listen->::listen开始监听
-        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        if (busyPollUs_ > 0)
+        {
+            for (EventLoop *ioLoop : threadPool_->getAllLoops())
+            {
+                ioLoop->setBusyPoll(busyPollUs_);
+            }
+        }
+        if (maxReadBytesPerIteration_ > 0 || maxFunctorsPerIteration_ > 0)
+        {
+            for (EventLoop *ioLoop : threadPool_->getAllLoops())
+            {
+                ioLoop->setMaxReadBytesPerIteration(maxReadBytesPerIteration_);
+                ioLoop->setMaxFunctorsPerIteration(maxFunctorsPerIteration_);
+            }
+        }
+        if (idleTimeoutSeconds_ > 0)
+        { // 每个subloop创建一个时间轮，每秒tick一次
+            for (EventLoop *ioLoop : threadPool_->getAllLoops())
+            {
+                std::shared_ptr<TimingWheel> wheel(new TimingWheel(ioLoop, idleTimeoutSeconds_, 1.0, onIdleExpired));
+                idleWheels_[ioLoop] = wheel;
+                ioLoop->runInLoop(std::bind(&TimingWheel::start, wheel));
+            }
+        }
+        if (stallThresholdMs_ > 0)
+        {
+            watchdog_.reset(new StallWatchdog(stallThresholdMs_, stallCallback_));
+            watchdog_->watch(loop_);
+            for (EventLoop *ioLoop : threadPool_->getAllLoops())
+            {
+                if (ioLoop != loop_)
+                { // 没有subloop时getAllLoops返回的就是mainloop
+                    watchdog_->watch(ioLoop);
+                }
+            }
+            watchdog_->start();
+        }
+        if (option_ == KReusePortPerLoop || option_ == KExclusiveAcceptPerLoop)
+        {
+            startLoopAcceptors();
+        }
+        else
+        {
+            setupAdmission(acceptor_.get());
+            // 调用runInloop->Acceeptor::listen->::listen开始监听
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        }
+    }
+}
+
+void TcpServer::startLoopAcceptors()
+{
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    const int n = static_cast<int>(loops.size());
+    if (option_ == KExclusiveAcceptPerLoop)
+    { // mainloop的acceptor只负责监听，不注册到mainloop
+        acceptor_->listenSocket();
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        std::shared_ptr<Acceptor> acceptor;
+        if (option_ == KReusePortPerLoop)
+        {
+            acceptor.reset(new Acceptor(loops[i], listenAddr_, true));
+            // 按loop的顺序进入监听状态，socket在SO_REUSEPORT组中的编号就是loop的下标
+            acceptor->listenSocket();
+        }
+        else
+        {
+            // dup出来的fd和原来的fd是同一个监听socket，每个loop注册自己的fd
+            int listenfd = ::dup(acceptor_->fd());
+            if (listenfd < 0)
+            {
+                LOG_FATAL("%s:%s:%d TcpServer::startLoopAcceptors dup listenfd error %d\n"
+                            , __FILE__, __FUNCTION__, __LINE__, errno);
+            }
+            acceptor.reset(new Acceptor(loops[i], listenfd));
+            acceptor->setExclusive(loops[i]->exclusiveWakeupSupported());
+        }
+        acceptor->setNewConnectionCallback(std::bind(&TcpServer::newConnectionInLoop, this, loops[i],
+                                                     std::placeholders::_1, std::placeholders::_2));
+        setupAdmission(acceptor.get());
+        loopAcceptors_.push_back(acceptor);
+    }
+    if (option_ == KReusePortPerLoop && reusePortCpuSteering_ && n > 1)
+    {
+        loopAcceptors_.front()->attachCpuSteering(threadPool_->cpuToLoop(), n);
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        loops[i]->runInLoop(std::bind(&Acceptor::listen, loopAcceptors_[i]));
+    }
+}
+
+void TcpServer::stop(double timeoutSeconds, const StopCallback &cb)
+{
+    loop_->runInLoop(std::bind(&TcpServer::stopInLoop, this, timeoutSeconds, cb));
+}
+
+void TcpServer::stopInLoop(double timeoutSeconds, const StopCallback &cb)
+{
+    if (stopping_.exchange(true))
+    {
+        return;
+    }
+    stopCallback_ = cb;
+
+    if (acceptor_)
+    {
+        acceptor_->stop();
+    }
+    for (const std::shared_ptr<Acceptor> &acceptor : loopAcceptors_)
+    {
+        acceptor->ownerLoop()->runInLoop(std::bind(&Acceptor::stop, acceptor));
+    }
+    std::vector<TcpConnectionPtr> connections;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex_);
+        for (auto &item : connections_)
+        {
+            connections.push_back(item.second);
+        }
+    }
+    LOG_INFO("%s:%s:%d   TcpServer::stop [%s] draining %d connections in %.1f seconds\n"
+                , __FILE__, __FUNCTION__, __LINE__, name_.c_str(), static_cast<int>(connections.size()), timeoutSeconds);
+    if (connections.empty())
+    {
+        finishStop();
+        return;
+    }
+    stopTimer_ = loop_->runAfter(timeoutSeconds, std::bind(&TcpServer::forceCloseAll, this));
+    for (const TcpConnectionPtr &conn : connections)
+    { // shutdown会等outputBuffer中的数据发送完再关闭写端
+        conn->getLoop()->runInLoop(std::bind(&TcpConnection::shutdown, conn));
+    }
+}
+
+void TcpServer::forceCloseAll()
+{
+    std::vector<TcpConnectionPtr> connections;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex_);
+        for (auto &item : connections_)
+        {
+            connections.push_back(item.second);
+        }
+    }
+    LOG_INFO("%s:%s:%d   TcpServer::stop [%s] deadline passed, force close %d connections\n"
+                , __FILE__, __FUNCTION__, __LINE__, name_.c_str(), static_cast<int>(connections.size()));
+    for (const TcpConnectionPtr &conn : connections)
+    {
+        conn->forceClose();
+    }
+}
+
+void TcpServer::finishStop()
+{
+    loop_->cancel(stopTimer_);
+    if (stopCallback_)
+    { // 放到回调队列中执行，回调中可以析构TcpServer
+        loop_->queueINLoop(std::move(stopCallback_));
+        stopCallback_ = StopCallback();
+    }
+}
+
+void TcpServer::setupAdmission(Acceptor *acceptor)
+{
+    acceptor->setOverloadPause(acceptPauseSeconds_);
+    acceptor->setAdmissionCallback(std::bind(&TcpServer::admitConnection, this, acceptor, std::placeholders::_1));
+}
+
+bool TcpServer::admitConnection(Acceptor *acceptor, const InetAddress &peerAddr)
+{
+    if (!reserveConnection())
+    { // 连接满了，队列里剩下的连接也会被拒绝，暂停一段时间再接受
+        rejectedMaxConnections_.fetch_add(1, std::memory_order_relaxed);
+        acceptor->pause(acceptPauseSeconds_);
+        return false;
     }
+    if (rateLimiter_ && !rateLimiter_->allow(peerAddr.getsockaddr()->sin_addr.s_addr,
+                                             Timestamp::monotonicNow().microSecondsSinceEpoch()))
+    { // 归还刚才占的名额
+        numConnections_.fetch_sub(1, std::memory_order_relaxed);
+        rejectedRateLimit_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    accepted_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+// 每个loop自己监听时多个acceptor并发准入，先检查再加一会超过上限，这里用CAS原子地占一个名额
+bool TcpServer::reserveConnection()
+{
+    int n = numConnections_.load(std::memory_order_relaxed);
+    do
+    {
+        if (maxConnections_ > 0 && n >= maxConnections_)
+        {
+            return false;
+        }
+    } while (!numConnections_.compare_exchange_weak(n, n + 1, std::memory_order_relaxed));
+    return true;
+}
+
+void TcpServer::addConnections(EventLoop *ioloop, int delta)
+{
+    numConnections_.fetch_add(delta, std::memory_order_relaxed);
+    ioloop->addConnections(delta);
+}
+
+TcpServer::AcceptStats TcpServer::acceptStats() const
+{
+    AcceptStats stats;
+    stats.accepted = accepted_.load(std::memory_order_relaxed);
+    stats.rejectedMaxConnections = rejectedMaxConnections_.load(std::memory_order_relaxed);
+    stats.rejectedRateLimit = rejectedRateLimit_.load(std::memory_order_relaxed);
+    stats.rejectedFdLimit = acceptor_ ? acceptor_->fdLimitRejections() : 0;
+    stats.pauses = acceptor_ ? acceptor_->pauses() : 0;
+    for (const std::shared_ptr<Acceptor> &acceptor : loopAcceptors_)
+    {
+        stats.rejectedFdLimit += acceptor->fdLimitRejections();
+        stats.pauses += acceptor->pauses();
+    }
+    return stats;
 }
 
 // 打包新的连接，并分发给subloop
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
-    // 选择一个subloop -> 这里采用轮询的方式进行选择
-    EventLoop *ioloop = threadPool_->getNextLoop();
+    // 选择一个subloop -> 按设置的策略选择(默认轮询)，或者选择处理这个连接数据包的CPU上的subloop
+    EventLoop *ioloop = incomingCpuDispatch_ ? threadPool_->getLoopForCpu(incomingCpu(sockfd))
+                                             : threadPool_->getLoopForPeer(peerAddr);
+    // 服务器的连接数在admitConnection中已经计入，这里计入subloop的连接数
+    ioloop->addConnections(1);
+    // 先按subloop攒起来，这一批接受完之后统一分发
+    pendingConnections_[ioloop].push_back(PendingConnection{sockfd, peerAddr});
+}
 
-    // 封装这个新连接的名字
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
-    std::string connName = name_ + buf;
+// 每个subloop的一批连接只投递一个回调，只唤醒一次
+void TcpServer::dispatchPendingConnections()
+{
+    for (auto &item : pendingConnections_)
+    {
+        if (!item.second.empty())
+        {
+            PendingConnectionList batch;
+            batch.swap(item.second);
+            item.first->runInLoop(std::bind(&TcpServer::establishConnections, this, item.first, std::move(batch)));
+        }
+    }
+}
 
-    LOG_INFO("%s:%s:%d   TcpServer::newConnection [%s] - new connection [%s] from %s \n", __FILE__, __FUNCTION__, __LINE__,
-             name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
+// 在ioloop中创建并建立一批连接
+void TcpServer::establishConnections(EventLoop *ioloop, const PendingConnectionList &batch)
+{
+    if (stopping_)
+    { // 停止监听之前已经接受的连接
+        for (const PendingConnection &pending : batch)
+        {
+            ::close(pending.sockfd);
+        }
+        addConnections(ioloop, -static_cast<int>(batch.size()));
+        return;
+    }
+    std::vector<TcpConnectionPtr> conns;
+    conns.reserve(batch.size());
+    for (const PendingConnection &pending : batch)
+    {
+        conns.push_back(newTcpConnection(ioloop, pending.sockfd, pending.peerAddr));
+    }
+    if (!insertConnections(conns))
+    { // 创建连接的过程中开始停止，连接对象析构时关闭socket
+        addConnections(ioloop, -static_cast<int>(conns.size()));
+        return;
+    }
+    for (const TcpConnectionPtr &conn : conns)
+    {
+        conn->connectEstablished();
+    }
+}
+
+void TcpServer::newConnectionInLoop(EventLoop *ioloop, int sockfd, const InetAddress &peerAddr)
+{
+    if (stopping_)
+    { // 停止监听之前已经接受的连接，归还admitConnection中占的名额
+        ::close(sockfd);
+        numConnections_.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+    ioloop->addConnections(1);
+    std::vector<TcpConnectionPtr> conns(1, newTcpConnection(ioloop, sockfd, peerAddr));
+    if (!insertConnections(conns))
+    {
+        addConnections(ioloop, -1);
+        return;
+    }
+    conns.front()->connectEstablished();
+}
 
-    // 获取本地localAddr 也就是获取当前服务器的地址
-    sockaddr_in localaddr;
-    bzero(&localaddr, sizeof localaddr);
-    socklen_t addrlen = sizeof localaddr;
-    if (::getsockname(sockfd, (sockaddr *)&localaddr, &addrlen) < 0)
+// 在锁里再检查一次stopping_：stopInLoop先设置stopping_再在锁里取所有连接，
+// 插入在取之前的连接会被stopInLoop关闭，在取之后的这里一定能看到stopping_
+bool TcpServer::insertConnections(const std::vector<TcpConnectionPtr> &conns)
+{
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    if (stopping_)
+    {
+        return false;
+    }
+    for (const TcpConnectionPtr &conn : conns)
     {
-        LOG_ERROR("%s:%s:%d   TcpServer::newConnection getsockname error\n", __FILE__, __FUNCTION__, __LINE__);
+        connections_[conn->name()] = conn;
     }
-    InetAddress localAddr(localaddr);
+    return true;
+}
+
+TcpConnectionPtr TcpServer::newTcpConnection(EventLoop *ioloop, int sockfd, const InetAddress &peerAddr)
+{
+    // 封装这个新连接的名字，前缀在构造时拼好
+    std::string connName = connNamePrefix_ + std::to_string(nextConnId_++);
 
+    LOG_DEBUG("%s:%s:%d   TcpServer::newConnection [%s] - new connection [%s] from %s \n", __FILE__, __FUNCTION__, __LINE__,
+             name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
+
+    // 本地地址就是监听的地址，监听通配地址时由TcpConnection在用到时再getsockname
     // 创建一个新的连接，使用智能指针管理(TcpConnectionPtr)
-    TcpConnectionPtr conn(new TcpConnection(ioloop, connName, sockfd, localAddr, peerAddr));
-    // 将新的连接放入TcpServer保存连接的map中
-    connections_[connName] = conn;
+    TcpConnectionPtr conn(new TcpConnection(ioloop, connName, sockfd, listenAddr_, peerAddr));
 
     // 设置这个连接的回调操作
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
     conn->setCloseCallback(std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
-
-    ioloop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    conn->setEdgeTriggered(edgeTriggered_);
+    if (socketBusyPollUs_ > 0)
+    {
+        conn->setBusyPoll(socketBusyPollUs_);
+    }
+    if (!idleWheels_.empty())
+    {
+        conn->setIdleWheel(idleWheels_.at(ioloop));
+    }
+    return conn;
 }
 
-// 移除一个连接
+// 移除一个连接，在连接所属的loop中完成，不需要经过mainloop
 void TcpServer::removeConnection(const TcpConnectionPtr &conn)
 {
-    loop_->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+    conn->getLoop()->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, this, conn));
 }
 
 // 从loop中移除一个连接
@@ -110,10 +475,23 @@ void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
 {
     LOG_INFO("%s:%s:%d   TcpServer::removeConnectionInLoop [%s] -connection [%s]\n", __FILE__, __FUNCTION__, __LINE__, name_.c_str(), conn->name().c_str());
 
-    // 从TcpServer的map中删除
-    connections_.erase(conn->name());
     // 获取当前连接所属的loop
     EventLoop *ioLoop = conn->getLoop();
+    // 从TcpServer的map中删除
+    bool empty = false;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex_);
+        if (connections_.erase(conn->name()) > 0)
+        {
+            addConnections(ioLoop, -1);
+        }
+        empty = connections_.empty();
+    }
     // 注册回调函数TcpConnection::connectDestroyed 将conn连接删除掉
     ioLoop->queueINLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+
+    if (stopping_ && empty)
+    {
+        loop_->runInLoop(std::bind(&TcpServer::finishStop, this));
+    }
 }
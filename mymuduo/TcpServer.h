@@ -6,26 +6,48 @@
 #include "EventLoop.h"
 #include "EventLoopThreadPool.h"
 #include "InetAddress.h"
+#include "RateLimiter.h"
+#include "StallWatchdog.h"
 #include "TcpConnection.h"
 #include "Timestamp.h"
+#include "TimingWheel.h"
 #include "noncopyable.h"
 
 #include <atomic>
 #include <functional>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 class TcpServer : noncpoyable
 {
 
 public:
     using ThreadInitCallback = std::function<void(EventLoop *)>;
+    using StopCallback = std::function<void()>;
+
+    // 接受连接的统计，任意线程都可以读取
+    struct AcceptStats
+    {
+        uint64_t accepted;               // 通过准入控制的连接个数
+        uint64_t rejectedMaxConnections; // 超过最大连接数被关闭的连接个数
+        uint64_t rejectedRateLimit;      // 同一个IP建立连接太快被关闭的连接个数
+        uint64_t rejectedFdLimit;        // fd用完时用预留的fd接受并关闭的连接个数
+        uint64_t pauses;                 // 暂停接受连接的次数
+    };
 
     // 设置Port的选项
     enum Option
     {
         kNoReusePort,
         KReusePort,
+        // 每个subloop一个绑定同一端口的SO_REUSEPORT监听socket，由内核分配新连接，
+        // 连接在接受它的loop中直接建立，不再经过mainloop，也不使用setDispatchPolicy/setIncomingCpuDispatch
+        KReusePortPerLoop,
+        // 只有一个监听socket，每个subloop用EPOLLEXCLUSIVE监听它，新连接只唤醒一个loop，
+        // 连接同样在接受它的loop中直接建立，poller不支持时退化为所有loop都被唤醒
+        KExclusiveAcceptPerLoop,
     };
     
     TcpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string nameArg,
@@ -46,9 +68,76 @@ public:
     // 获取EventLoop线程池对象
     std::shared_ptr<EventLoopThreadPool> threadPool() { return threadPool_; }
 
+    // 设置空闲连接的超时时间(秒)，超过这个时间没有读写的连接会被强制关闭，在start之前调用
+    void setIdleTimeout(int seconds) { idleTimeoutSeconds_ = seconds; }
+
+    // 新连接使用边沿触发(只有epoll支持)，在start之前调用
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+
+    // subloop使用忙轮询模式(见EventLoop::setBusyPoll)，socketBusyPollUs大于0时
+    // 新连接的socket同时开启SO_BUSY_POLL/SO_PREFER_BUSY_POLL，在start之前调用
+    void setBusyPoll(int spinUs, int socketBusyPollUs = 0)
+    {
+        busyPollUs_ = spinUs;
+        socketBusyPollUs_ = socketBusyPollUs;
+    }
+
+    // subloop的公平调度限制(见EventLoop::setMaxReadBytesPerIteration/setMaxFunctorsPerIteration)，
+    // 0表示不限制，在start之前调用
+    void setWorkBudget(size_t maxReadBytesPerConnection, size_t maxFunctors)
+    {
+        maxReadBytesPerIteration_ = maxReadBytesPerConnection;
+        maxFunctorsPerIteration_ = maxFunctors;
+    }
+
+    // 开启loop卡住检测：mainloop和subloop的一轮循环超过thresholdMs毫秒时报告正在执行的回调，
+    // cb为空时打印日志，在start之前调用
+    void setStallWatchdog(int thresholdMs, const StallWatchdog::StallCallback &cb = StallWatchdog::StallCallback())
+    {
+        stallThresholdMs_ = thresholdMs;
+        stallCallback_ = cb;
+    }
+
+    // KReusePortPerLoop模式下用CBPF程序按处理数据包的CPU选择监听socket(见Acceptor::attachCpuSteering)，
+    // 和setCpuAffinity一起使用时选绑定在这个CPU上的subloop，否则选第cpu % n个，在start之前调用
+    void setReusePortCpuSteering(bool on) { reusePortCpuSteering_ = on; }
+
+    // 新连接选择subloop的策略(见EventLoopThreadPool::DispatchPolicy)，默认轮询，在start之前调用
+    void setDispatchPolicy(EventLoopThreadPool::DispatchPolicy policy) { threadPool_->setDispatchPolicy(policy); }
+
+    // 第i个subloop绑定到cpuSets[i % cpuSets.size()]中的CPU上，在start之前调用
+    void setCpuAffinity(const std::vector<std::vector<int>> &cpuSets) { threadPool_->setCpuAffinity(cpuSets); }
+    // 新连接优先分给处理这个连接数据包的CPU(SO_INCOMING_CPU)上的subloop，其次是同一个NUMA节点上的
+    // 需要和setCpuAffinity一起使用，开启后不再使用setDispatchPolicy设置的策略，在start之前调用
+    void setIncomingCpuDispatch(bool on) { incomingCpuDispatch_ = on; }
+
+    // 设置subloop使用的IO复用实现(epoll/io_uring)，在start之前调用
+    void setPollerBackend(Poller::Backend backend) { threadPool_->setPollerBackend(backend); }
+
+    // 最多同时建立的连接个数，达到上限时新连接被直接关闭，并暂停接受连接(见setAcceptPause)，0表示不限制，在start之前调用
+    void setMaxConnections(int n) { maxConnections_ = n; }
+    // 每个客户端IP每秒最多建立rate个连接，允许瞬间建立burst个，超过的连接被直接关闭，在start之前调用
+    void setPerIpRateLimit(double rate, double burst)
+    {
+        rateLimiter_.reset(rate > 0 ? new RateLimiter(rate, burst) : nullptr);
+    }
+    // 达到最大连接数或者fd用完时暂停接受连接的时间(秒)，在start之前调用
+    void setAcceptPause(double seconds) { acceptPauseSeconds_ = seconds; }
+
+    // 当前的连接个数
+    int numConnections() const { return numConnections_.load(std::memory_order_relaxed); }
+    AcceptStats acceptStats() const;
+
     // 开启服务器
     void start();
 
+    // 优雅停止，可以在任意线程调用(比如SignalHandler的回调中)：
+    // 1、停止监听，新的连接请求被拒绝
+    // 2、每个连接在自己的loop中发送完已经交给它的数据后关闭写端，等对端关闭连接
+    // 3、timeoutSeconds秒后还没有关闭的连接强制关闭
+    // 所有连接都关闭后在mainloop中调用cb(比如调用loop->quit())
+    void stop(double timeoutSeconds, const StopCallback &cb = StopCallback());
+
     // 设置处理新连接的回调函数
     void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = std::move(cb); }
     // 设置处理已连接的数据读写回调函数
@@ -59,18 +148,59 @@ public:
 private:
     // 新的连接
     void newConnection(int sockfd, const InetAddress &peerAddr);
+    // mainloop接受的一批连接按subloop分组之后，每个subloop投递一次
+    void dispatchPendingConnections();
+    // 每个loop自己监听的模式下，在接受连接的loop中调用
+    void newConnectionInLoop(EventLoop *ioloop, int sockfd, const InetAddress &peerAddr);
+    // 接受连接之后的准入控制(最大连接数、按IP限速)，在acceptor所属的loop中调用
+    bool admitConnection(Acceptor *acceptor, const InetAddress &peerAddr);
+    // 没有超过最大连接数时占用一个连接名额，连接关闭或者被丢弃时通过addConnections归还
+    bool reserveConnection();
+    // 设置acceptor的准入控制回调
+    void setupAdmission(Acceptor *acceptor);
+    // 增减连接个数，同时计入loop的连接数
+    void addConnections(EventLoop *ioloop, int delta);
+    // 把新建的连接加入connections_，已经开始停止时不加入并返回false
+    bool insertConnections(const std::vector<TcpConnectionPtr> &conns);
+    // 创建连接对象，设置好回调
+    TcpConnectionPtr newTcpConnection(EventLoop *ioloop, int sockfd, const InetAddress &peerAddr);
+    // 每个subloop创建自己的Acceptor并开始监听
+    void startLoopAcceptors();
     // 移除一个连接
     void removeConnection(const TcpConnectionPtr &conn);
     // 从loop中移除一个连接
     void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    void stopInLoop(double timeoutSeconds, const StopCallback &cb);
+    // 停止的期限到了，强制关闭剩下的连接
+    void forceCloseAll();
+    // 所有连接都已经关闭
+    void finishStop();
+
+    // mainloop接受、还没有交给subloop的连接
+    struct PendingConnection
+    {
+        int sockfd;
+        InetAddress peerAddr;
+    };
+    using PendingConnectionList = std::vector<PendingConnection>;
+
+    // 在ioloop中创建并建立一批连接
+    void establishConnections(EventLoop *ioloop, const PendingConnectionList &batch);
 
     // 保存所有连接的数据结构(无序的map(hashmap))
     using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
 
     EventLoop *loop_; // the acceptor loop (main loop)
+    const InetAddress listenAddr_;
+    const Option option_;
     const std::string ipPort_;
     const std::string name_;
-    std::unique_ptr<Acceptor> acceptor_;              // mainloop对应的acceptor
+    const std::string connNamePrefix_; // 连接名字的前缀 name-ip:port#
+    // mainloop对应的acceptor，KExclusiveAcceptPerLoop模式下只提供被subloop共享的监听socket，KReusePortPerLoop模式下为空
+    std::unique_ptr<Acceptor> acceptor_;
+    // 每个loop自己监听的模式下各个subloop的acceptor，只能在所属的loop中析构
+    std::vector<std::shared_ptr<Acceptor>> loopAcceptors_;
+    bool reusePortCpuSteering_;
     std::shared_ptr<EventLoopThreadPool> threadPool_; // EventLoop线程池对象
 
     // 回调函数
@@ -81,6 +211,38 @@ private:
 
     std::atomic_int started_; // 标记TcpServer启动监听
 
-    int nextConnId_;            // 表示连接数
+    std::atomic_int nextConnId_; // 表示连接数
+    // 每个loop自己监听的模式下多个loop会同时增删连接，用锁保护
+    std::mutex connectionsMutex_;
     ConnectionMap connections_; //保存连接map表
+    // 这一批接受的连接按subloop分组，只在mainloop中访问
+    std::unordered_map<EventLoop *, PendingConnectionList> pendingConnections_;
+
+    int idleTimeoutSeconds_; // 空闲连接超时时间，0表示不检测
+    bool edgeTriggered_;     // 新连接是否使用边沿触发
+    int busyPollUs_;         // subloop忙轮询的时长(微秒)
+    int socketBusyPollUs_;   // 新连接socket的SO_BUSY_POLL(微秒)
+    size_t maxReadBytesPerIteration_; // 每个连接每轮最多读取的字节数
+    size_t maxFunctorsPerIteration_;  // subloop每轮最多执行的回调个数
+    bool incomingCpuDispatch_;        // 按SO_INCOMING_CPU选择subloop
+
+    // 准入控制
+    std::atomic_int numConnections_;  // 已经接受、还没有移除的连接个数
+    int maxConnections_;              // 最大连接数，0表示不限制
+    double acceptPauseSeconds_;       // 达到上限时暂停接受连接的时间
+    std::unique_ptr<RateLimiter> rateLimiter_; // 按客户端IP限速，为空表示不限制
+    std::atomic<uint64_t> accepted_;
+    std::atomic<uint64_t> rejectedMaxConnections_;
+    std::atomic<uint64_t> rejectedRateLimit_;
+    // 每个subloop一个检测空闲连接的时间轮
+    std::unordered_map<EventLoop *, std::shared_ptr<TimingWheel>> idleWheels_;
+
+    std::atomic_bool stopping_;  // 正在优雅停止
+    StopCallback stopCallback_;  // 只在mainloop中访问
+    TimerId stopTimer_;          // 强制关闭剩下连接的定时器
+
+    int stallThresholdMs_; // loop卡住的报告阈值(毫秒)，0表示不检测
+    StallWatchdog::StallCallback stallCallback_;
+    // 放在threadPool_之后，保证在subloop析构之前停止
+    std::unique_ptr<StallWatchdog> watchdog_;
 };
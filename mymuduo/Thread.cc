@@ -1,5 +1,6 @@
 #include "Thread.h"
 #include "CurrentThread.h"
+#include <pthread.h>
 #include <semaphore.h>
 
 std::atomic_int Thread::numCreated_(0);
@@ -34,6 +35,8 @@ void Thread::start()
     threadId_ = std::shared_ptr<std::thread>(new std::thread([&](){
         // 获取当前线程的tid
         tid_ = CurrentThread::tid();
+        // 线程名字最长15个字符，在top/perf/gdb中可以看到
+        ::pthread_setname_np(::pthread_self(), name_.substr(0, 15).c_str());
         sem_post(&sem); // 信号量加1
 
         func_(); // 执行线程函数
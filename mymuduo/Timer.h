@@ -0,0 +1,55 @@
+#pragma once
+#include "Callbacks.h"
+#include "noncopyable.h"
+#include "Timestamp.h"
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * 定时器，保存到期时间、重复间隔和到期时执行的回调
+ * 由TimerQueue管理，heapIndex_记录它在TimerQueue的4叉堆中的位置
+ */
+class Timer : noncpoyable
+{
+public:
+    Timer(TimerCallback cb, Timestamp when, double interval)
+        : callback_(std::move(cb))
+        , expiration_(when)
+        , interval_(interval)
+        , repeat_(interval > 0.0)
+        , sequence_(++numCreated_)
+        , heapIndex_(-1)
+        , canceled_(false)
+    {
+    }
+
+    // 执行定时器的回调
+    void run() const { callback_(); }
+
+    Timestamp expiration() const { return expiration_; }
+    bool repeat() const { return repeat_; }
+    int64_t sequence() const { return sequence_; }
+
+    // 重复的定时器从now开始重新计时
+    void restart(Timestamp now) { expiration_ = addTime(now, interval_); }
+
+    int heapIndex() const { return heapIndex_; }
+    void setHeapIndex(int index) { heapIndex_ = index; }
+
+    bool canceled() const { return canceled_; }
+    void setCanceled() { canceled_ = true; }
+
+    static int64_t numCreated() { return numCreated_; }
+
+private:
+    const TimerCallback callback_;
+    Timestamp expiration_; // 到期时间
+    const double interval_; // 重复间隔(秒)，不大于0表示只执行一次
+    const bool repeat_;
+    const int64_t sequence_; // 全局唯一的序号，TimerId通过它找到定时器
+    int heapIndex_;         // 在4叉堆中的下标，-1表示不在堆中
+    bool canceled_;         // 在本轮到期的定时器中被取消
+
+    static std::atomic<int64_t> numCreated_;
+};
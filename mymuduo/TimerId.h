@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * 用户取消定时器时使用的标识，可以随意拷贝
+ * 只保存定时器的序号，定时器到期或者被取消后再用它调用cancel是安全的
+ */
+class TimerId
+{
+public:
+    TimerId() : sequence_(0) {}
+    explicit TimerId(int64_t seq) : sequence_(seq) {}
+
+    int64_t sequence() const { return sequence_; }
+
+private:
+    int64_t sequence_;
+};
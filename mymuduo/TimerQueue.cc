@@ -0,0 +1,229 @@
+#include "TimerQueue.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "Timer.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <strings.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+std::atomic<int64_t> Timer::numCreated_(0);
+
+// 创建timerfd
+static int createTimerfd()
+{
+    int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d  timerfd_create error : %d \n"
+                  , __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return timerfd;
+}
+
+TimerQueue::TimerQueue(EventLoop *loop)
+    : loop_(loop)
+    , timerfd_(createTimerfd())
+    , timerfdChannel_(loop, timerfd_)
+{
+    timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
+    timerfdChannel_.enableReading();
+}
+
+TimerQueue::~TimerQueue()
+{
+    timerfdChannel_.disableAll();
+    timerfdChannel_.remove();
+    ::close(timerfd_);
+    for (auto &item : activeTimers_)
+    {
+        delete item.second;
+    }
+}
+
+// 定时器在调用者线程中创建，然后交给loop线程放入堆中
+TimerId TimerQueue::addTimer(TimerCallback cb, Timestamp when, double interval)
+{
+    Timer *timer = new Timer(std::move(cb), when, interval);
+    TimerId timerId(timer->sequence());
+    loop_->runInLoop(std::bind(&TimerQueue::addTimerInLoop, this, timer));
+    return timerId;
+}
+
+void TimerQueue::cancel(TimerId timerId)
+{
+    loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timerId));
+}
+
+void TimerQueue::addTimerInLoop(Timer *timer)
+{
+    activeTimers_[timer->sequence()] = timer;
+    heapPush(timer);
+    if (heap_.front() == timer)
+    { // 新的定时器最早到期，需要重新设置timerfd
+        resetTimerfd(timer->expiration());
+    }
+}
+
+void TimerQueue::cancelInLoop(TimerId timerId)
+{
+    auto it = activeTimers_.find(timerId.sequence());
+    if (it == activeTimers_.end())
+    { // 定时器已经到期或者已经被取消
+        return;
+    }
+    Timer *timer = it->second;
+    if (timer->heapIndex() >= 0)
+    { // timerfd可能还按这个定时器设置着，到时候handleRead发现没有到期的定时器会重新设置
+        heapRemove(timer->heapIndex());
+        activeTimers_.erase(it);
+        delete timer;
+    }
+    else
+    { // 在本轮到期的定时器中(比如在自己的回调里取消自己)，由handleRead处理
+        timer->setCanceled();
+    }
+}
+
+// timerfd可读时的回调，取出所有到期的定时器批量执行
+void TimerQueue::handleRead()
+{
+    uint64_t howmany = 0;
+    ssize_t n = ::read(timerfd_, &howmany, sizeof howmany);
+    if (n != sizeof howmany && errno != EAGAIN)
+    {
+        LOG_ERROR("%s:%s:%d  TimerQueue::handleRead() reads %ld bytes instead of 8\n"
+                  , __FILE__, __FUNCTION__, __LINE__, n);
+    }
+
+    Timestamp now(Timestamp::monotonicNow());
+    expired_.clear();
+    while (!heap_.empty() && !(now < heap_.front()->expiration()))
+    {
+        Timer *timer = heap_.front();
+        heapRemove(0);
+        expired_.push_back(timer);
+    }
+
+    for (Timer *timer : expired_)
+    {
+        if (!timer->canceled())
+        {
+            timer->run();
+        }
+    }
+
+    // 重复的定时器重新放入堆中，其余的释放掉
+    for (Timer *timer : expired_)
+    {
+        if (timer->repeat() && !timer->canceled())
+        {
+            timer->restart(now);
+            heapPush(timer);
+        }
+        else
+        {
+            activeTimers_.erase(timer->sequence());
+            delete timer;
+        }
+    }
+    expired_.clear();
+
+    if (!heap_.empty())
+    {
+        resetTimerfd(heap_.front()->expiration());
+    }
+}
+
+void TimerQueue::heapPush(Timer *timer)
+{
+    heap_.push_back(timer);
+    timer->setHeapIndex(static_cast<int>(heap_.size()) - 1);
+    heapSiftUp(timer->heapIndex());
+}
+
+// 删除下标为index的节点：用最后一个节点补上，再向上或向下调整
+void TimerQueue::heapRemove(int index)
+{
+    Timer *removed = heap_[index];
+    Timer *last = heap_.back();
+    heap_.pop_back();
+    removed->setHeapIndex(-1);
+    if (last != removed)
+    {
+        heapSet(index, last);
+        heapSiftUp(index);
+        heapSiftDown(last->heapIndex());
+    }
+}
+
+void TimerQueue::heapSiftUp(int index)
+{
+    Timer *timer = heap_[index];
+    while (index > 0)
+    {
+        int parent = (index - 1) / KHeapArity;
+        if (!(timer->expiration() < heap_[parent]->expiration()))
+        {
+            break;
+        }
+        heapSet(index, heap_[parent]);
+        index = parent;
+    }
+    heapSet(index, timer);
+}
+
+void TimerQueue::heapSiftDown(int index)
+{
+    const int size = static_cast<int>(heap_.size());
+    Timer *timer = heap_[index];
+    for (;;)
+    {
+        int first = index * KHeapArity + 1;
+        if (first >= size)
+        {
+            break;
+        }
+        // 找到最早到期的子节点
+        int child = first;
+        int last = std::min(first + KHeapArity, size);
+        for (int i = first + 1; i < last; ++i)
+        {
+            if (heap_[i]->expiration() < heap_[child]->expiration())
+            {
+                child = i;
+            }
+        }
+        if (!(heap_[child]->expiration() < timer->expiration()))
+        {
+            break;
+        }
+        heapSet(index, heap_[child]);
+        index = child;
+    }
+    heapSet(index, timer);
+}
+
+void TimerQueue::heapSet(int index, Timer *timer)
+{
+    heap_[index] = timer;
+    timer->setHeapIndex(index);
+}
+
+// 设置timerfd的到期时间，timerfd和定时器都使用单调时钟，直接设置绝对时间
+// 已经到期的时间也会让timerfd马上触发一次
+void TimerQueue::resetTimerfd(Timestamp expiration)
+{
+    int64_t microseconds = std::max(expiration.microSecondsSinceEpoch(), static_cast<int64_t>(1));
+    itimerspec newValue;
+    bzero(&newValue, sizeof newValue);
+    newValue.it_value.tv_sec = static_cast<time_t>(microseconds / Timestamp::KMicroSecondsPerSecond);
+    newValue.it_value.tv_nsec = static_cast<long>((microseconds % Timestamp::KMicroSecondsPerSecond) * 1000);
+    if (::timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &newValue, nullptr) < 0)
+    {
+        LOG_ERROR("%s:%s:%d  timerfd_settime error : %d \n"
+                  , __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "Callbacks.h"
+#include "Channel.h"
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "TimerId.h"
+
+#include <unordered_map>
+#include <vector>
+
+class EventLoop;
+class Timer;
+
+/**
+ * EventLoop的定时器队列
+ * 所有定时器用一个timerfd驱动，timerfd封装成Channel注册到loop的Poller中
+ * 定时器按到期时间保存在4叉最小堆中，添加和取消都是O(log n)
+ * 到期时间使用单调时钟(Timestamp::monotonicNow)，和timerfd的时钟一致，修改系统时间不影响定时器
+ * timerfd可读时一次取出所有到期的定时器，批量执行
+ */
+class TimerQueue : noncpoyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 添加定时器，when是单调时钟的到期时间，可以在其他线程调用
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+    // 取消定时器，可以在其他线程调用
+    void cancel(TimerId timerId);
+
+    // 当前还没有到期的定时器个数
+    size_t size() const { return activeTimers_.size(); }
+
+private:
+    // 4叉堆每个节点的子节点个数
+    static const int KHeapArity = 4;
+
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+    // timerfd可读时的回调，执行所有到期的定时器
+    void handleRead();
+
+    // 4叉堆的操作
+    void heapPush(Timer *timer);
+    void heapRemove(int index);
+    void heapSiftUp(int index);
+    void heapSiftDown(int index);
+    void heapSet(int index, Timer *timer);
+
+    // 让timerfd在expiration时间(单调时钟)到期
+    void resetTimerfd(Timestamp expiration);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+
+    // 按到期时间排序的4叉最小堆
+    std::vector<Timer *> heap_;
+    // 序号 -> 定时器，用于cancel时找到定时器
+    std::unordered_map<int64_t, Timer *> activeTimers_;
+    // 本轮到期的定时器
+    std::vector<Timer *> expired_;
+};
@@ -1,5 +1,6 @@
 #include "Timestamp.h"
 
+#include <sys/time.h>
 #include <time.h>
 
 Timestamp::Timestamp() : microSecondsSinceEpoch_(0)
@@ -14,14 +15,24 @@ Timestamp::Timestamp(int64_t microSecondsSinceEpoch)
 // 获取当前时间,静态方法
 Timestamp Timestamp::now()
 {
-    return Timestamp(time(nullptr));
+    timeval tv;
+    gettimeofday(&tv, nullptr);
+    return Timestamp(static_cast<int64_t>(tv.tv_sec) * KMicroSecondsPerSecond + tv.tv_usec);
+}
+
+Timestamp Timestamp::monotonicNow()
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return Timestamp(static_cast<int64_t>(ts.tv_sec) * KMicroSecondsPerSecond + ts.tv_nsec / 1000);
 }
 
 // 将时间转换为字符串
 std::string Timestamp::toString() const
 {
     char buf[128] = {0};
-    tm *tm_time = localtime(&microSecondsSinceEpoch_);
+    time_t seconds = static_cast<time_t>(microSecondsSinceEpoch_ / KMicroSecondsPerSecond);
+    tm *tm_time = localtime(&seconds);
     snprintf(buf,128,"%4d/%02d/%02d %02d:%02d:%02d",
         tm_time->tm_year + 1900,
         tm_time->tm_mon + 1,
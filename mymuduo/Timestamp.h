@@ -1,5 +1,6 @@
 #pragma once
 #include <iostream>
+#include <stdint.h>
 #include <string>
 class Timestamp
 {
@@ -10,10 +11,37 @@ public:
     
     // 获取当前时间
     static Timestamp now();
+    // 单调时钟的当前时间，不受修改系统时间(NTP、settimeofday)的影响，只能用来计算时间间隔和期限
+    static Timestamp monotonicNow();
 
     // 将时间转换为字符串
     std::string toString()const; 
+
+    // 返回微秒表示的时间
+    int64_t microSecondsSinceEpoch() const { return microSecondsSinceEpoch_; }
+    // 是否是一个有效的时间
+    bool valid() const { return microSecondsSinceEpoch_ > 0; }
+
+    // 一秒对应的微秒数
+    static const int KMicroSecondsPerSecond = 1000 * 1000;
 private:
     // 记录时间的64位整型
     int64_t microSecondsSinceEpoch_; 
-};
\ No newline at end of file
+};
+
+inline bool operator<(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator==(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch();
+}
+
+// 返回timestamp加上seconds秒之后的时间
+inline Timestamp addTime(Timestamp timestamp, double seconds)
+{
+    int64_t delta = static_cast<int64_t>(seconds * Timestamp::KMicroSecondsPerSecond);
+    return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
+}
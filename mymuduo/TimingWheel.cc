@@ -0,0 +1,104 @@
+#include "TimingWheel.h"
+#include "EventLoop.h"
+
+TimingWheel::TimingWheel(EventLoop *loop, int numTicks, double tickSeconds, const ExpireCallback &cb)
+    : loop_(loop)
+    , numTicks_(numTicks > 0 ? numTicks : 1)
+    , tickSeconds_(tickSeconds)
+    , expireCallback_(cb)
+    , currentTick_(0)
+    , buckets_(numTicks_)
+{
+    for (Entry &head : buckets_)
+    {
+        head.prev = &head;
+        head.next = &head;
+    }
+}
+
+TimingWheel::~TimingWheel()
+{
+    // 剩下的Entry从时间轮上摘下来，防止被管理的对象再访问时间轮
+    for (Entry &head : buckets_)
+    {
+        while (head.next != &head)
+        {
+            unlink(head.next);
+        }
+    }
+}
+
+// tick定时器持有时间轮的shared_ptr，stop之前时间轮不会被析构
+void TimingWheel::start()
+{
+    timerId_ = loop_->runEvery(tickSeconds_, std::bind(&TimingWheel::tick, shared_from_this()));
+}
+
+void TimingWheel::stop()
+{
+    loop_->cancel(timerId_);
+}
+
+void TimingWheel::add(Entry *entry)
+{
+    entry->lastActive = currentTick_;
+    link(entry);
+}
+
+void TimingWheel::remove(Entry *entry)
+{
+    if (entry->linked())
+    {
+        unlink(entry);
+    }
+}
+
+// 只检查当前tick对应的桶
+void TimingWheel::tick()
+{
+    ++currentTick_;
+    Entry &head = buckets_[currentTick_ % numTicks_];
+    if (head.next == &head)
+    {
+        return;
+    }
+    // 先把整个桶摘下来，重新挂回来的Entry不会在这一轮再被检查
+    Entry *entry = head.next;
+    head.prev->next = nullptr;
+    head.prev = &head;
+    head.next = &head;
+
+    while (entry != nullptr)
+    {
+        Entry *next = entry->next;
+        entry->prev = nullptr;
+        entry->next = nullptr;
+        if (currentTick_ - entry->lastActive >= static_cast<uint64_t>(numTicks_))
+        { // 整个周期都没有活动，超时
+            expireCallback_(entry);
+        }
+        else
+        { // 期间有过活动，挪到最后一次活动对应的桶
+            link(entry);
+        }
+        entry = next;
+    }
+}
+
+// 挂到最后一次活动对应的桶上，numTicks_个tick后再检查
+void TimingWheel::link(Entry *entry)
+{
+    Entry &head = buckets_[entry->lastActive % numTicks_];
+    entry->prev = head.prev;
+    entry->next = &head;
+    head.prev->next = entry;
+    head.prev = entry;
+}
+
+void TimingWheel::unlink(Entry *entry)
+{
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->prev = nullptr;
+    entry->next = nullptr;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "noncopyable.h"
+#include "TimerId.h"
+
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+class EventLoop;
+
+/**
+ * 每个EventLoop上的时间轮，用来检测长时间没有活动的对象(比如空闲连接)
+ * 被管理的对象内嵌一个Entry，Entry通过侵入式双向链表挂在某个桶上
+ * touch只记录一下当前的tick，不需要系统调用也不分配内存；
+ * 每个tick只检查一个桶，期间活动过的Entry挪到新的桶里，真正超时的交给ExpireCallback
+ * 所有操作都只能在loop线程中进行，ExpireCallback中不能remove其他的Entry
+ */
+class TimingWheel : noncpoyable, public std::enable_shared_from_this<TimingWheel>
+{
+public:
+    // 内嵌到被管理对象中的节点
+    struct Entry
+    {
+        Entry() : prev(nullptr), next(nullptr), lastActive(0), context(nullptr) {}
+        bool linked() const { return prev != nullptr; }
+
+        Entry *prev;
+        Entry *next;
+        uint64_t lastActive; // 最后一次活动时的tick
+        void *context;       // 被管理的对象
+    };
+
+    using ExpireCallback = std::function<void(Entry *)>;
+
+    // 超时时间为numTicks个tick，每个tick为tickSeconds秒
+    TimingWheel(EventLoop *loop, int numTicks, double tickSeconds, const ExpireCallback &cb);
+    ~TimingWheel();
+
+    // 在loop上启动/停止tick定时器
+    void start();
+    void stop();
+
+    void add(Entry *entry);
+    void remove(Entry *entry);
+    // 记录entry在当前tick有活动
+    void touch(Entry *entry) { entry->lastActive = currentTick_; }
+
+private:
+    void tick();
+    void link(Entry *entry);
+    static void unlink(Entry *entry);
+
+    EventLoop *loop_;
+    const int numTicks_;
+    const double tickSeconds_;
+    ExpireCallback expireCallback_;
+    uint64_t currentTick_;
+    std::vector<Entry> buckets_; // 每个桶是一个带头节点的循环双向链表
+    TimerId timerId_;
+};
@@ -0,0 +1,103 @@
+#include <mymuduo/ChannelTable.h>
+#include <mymuduo/Timestamp.h>
+
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * 比较Poller保存Channel的两种结构：
+ *  map   : 原来的unordered_map<int, Channel*>
+ *  table : 用fd作下标的ChannelTable(带注册编号)
+ * 三个阶段：注册全部fd、按随机顺序查找(模拟fillActionChannels)、连接断开重连(删除再注册)
+ * 用法：./bench_channel_table [fd个数]
+ */
+
+static int64_t nowUs()
+{
+    return Timestamp::now().microSecondsSinceEpoch();
+}
+
+// 只比较指针，不会解引用
+static Channel *fakeChannel(int fd)
+{
+    return reinterpret_cast<Channel *>(static_cast<uintptr_t>(fd + 1) << 4);
+}
+
+struct MapTable
+{
+    void add(int fd, Channel *channel) { channels[fd] = channel; }
+    void remove(int fd) { channels.erase(fd); }
+    Channel *find(int fd) const
+    {
+        auto it = channels.find(fd);
+        return it != channels.end() ? it->second : nullptr;
+    }
+    std::unordered_map<int, Channel *> channels;
+};
+
+struct FlatTable
+{
+    void add(int fd, Channel *channel) { channels.add(fd, channel); }
+    void remove(int fd) { channels.remove(fd); }
+    Channel *find(int fd) const { return channels.find(fd, channels.generation(fd)); }
+    ChannelTable channels;
+};
+
+template <typename Table>
+static void run(const char *name, const std::vector<int> &fds, const std::vector<int> &order)
+{
+    Table table;
+    const double n = static_cast<double>(fds.size());
+
+    int64_t start = nowUs();
+    for (int fd : fds)
+    {
+        table.add(fd, fakeChannel(fd));
+    }
+    int64_t added = nowUs();
+
+    size_t hits = 0;
+    for (int fd : order)
+    {
+        hits += table.find(fd) == fakeChannel(fd);
+    }
+    int64_t found = nowUs();
+
+    // 断开重连：删除一个fd之后马上用同一个fd注册新的连接
+    for (int fd : order)
+    {
+        table.remove(fd);
+        table.add(fd, fakeChannel(fd));
+    }
+    int64_t churned = nowUs();
+
+    printf("%-6s fds=%zu  add %6.1f ns/op  find %6.1f ns/op  churn %6.1f ns/op  hits=%zu\n",
+           name, fds.size(),
+           (added - start) * 1000.0 / n,
+           (found - added) * 1000.0 / n,
+           (churned - found) * 1000.0 / n,
+           hits);
+}
+
+int main(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    std::vector<int> fds(count);
+    for (int i = 0; i < count; ++i)
+    {
+        fds[i] = i + 3; // 0/1/2是标准输入输出
+    }
+    std::vector<int> order(fds);
+    std::shuffle(order.begin(), order.end(), std::mt19937(12345));
+
+    for (int round = 0; round < 3; ++round)
+    {
+        run<MapTable>("map", fds, order);
+        run<FlatTable>("table", fds, order);
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <mymuduo/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * 连接建立和关闭的速度(连接/秒)，模拟客户端断线重连的风暴
+ * 服务器和客户端在同一个进程中，每个客户端线程不停地connect、等服务器回一个字节、关闭
+ * 客户端用SO_LINGER(0)关闭，不留TIME_WAIT，避免本地端口耗尽
+ * 模式：0 mainloop接受连接再分发给subloop，2 每个subloop一个SO_REUSEPORT监听socket，
+ *       3 每个subloop用EPOLLEXCLUSIVE监听同一个socket
+ * 日志是同步打印到标准输出的，结果打印到标准错误：./bench_churn 0 4 4 5 > /dev/null
+ * 用法：./bench_churn [模式] [subloop个数] [客户端线程数] [秒数]
+ */
+
+static const uint16_t KPort = 9981;
+
+static std::atomic<bool> running(true);
+static std::atomic<long> connects(0);
+static std::atomic<long> failures(0);
+
+static void clientThread()
+{
+    sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(KPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    linger lin = {1, 0};
+    while (running.load(std::memory_order_relaxed))
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        char c;
+        if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) == 0 && ::read(fd, &c, 1) == 1)
+        {
+            connects.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            failures.fetch_add(1, std::memory_order_relaxed);
+        }
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof lin);
+        ::close(fd);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int mode = argc > 1 ? atoi(argv[1]) : 0;
+    int numLoops = argc > 2 ? atoi(argv[2]) : 4;
+    int numClients = argc > 3 ? atoi(argv[3]) : 4;
+    int seconds = argc > 4 ? atoi(argv[4]) : 5;
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(KPort), "churn", static_cast<TcpServer::Option>(mode));
+    server.setThreadNum(numLoops);
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            conn->send("x", 1);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+    server.start();
+
+    std::vector<std::thread> clients;
+    std::thread timer([&] {
+        for (int i = 0; i < numClients; ++i)
+        {
+            clients.emplace_back(clientThread);
+        }
+        long last = 0;
+        for (int s = 0; s < seconds; ++s)
+        {
+            sleep(1);
+            long now = connects.load();
+            fprintf(stderr, "mode=%d loops=%d clients=%d  %8ld conn/s\n", mode, numLoops, numClients, now - last);
+            last = now;
+        }
+        running = false;
+        for (std::thread &t : clients)
+        {
+            t.join();
+        }
+        fprintf(stderr, "mode=%d loops=%d clients=%d  average %8.0f conn/s  failures=%ld\n",
+                mode, numLoops, numClients, connects.load() / static_cast<double>(seconds), failures.load());
+        loop.quit();
+    });
+    loop.loop();
+    timer.join();
+    return 0;
+}
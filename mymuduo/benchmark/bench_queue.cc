@@ -0,0 +1,188 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/EventLoopThread.h>
+#include <mymuduo/MpscQueue.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * 比较EventLoop跨线程投递回调的两种实现：
+ *  mutex : 原来的mutex + vector，每次入队都写eventfd
+ *  mpsc  : 无锁MpscQueue，loop取走回调之前只有第一个入队的线程写eventfd
+ * 另外直接用EventLoop::queueINLoop测一遍
+ * 用法：./bench_queue [每轮回调总数]
+ */
+
+using Functor = std::function<void()>;
+
+static int64_t nowUs()
+{
+    return Timestamp::now().microSecondsSinceEpoch();
+}
+
+// 原来的实现
+class MutexQueue
+{
+public:
+    void push(Functor cb)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            pending_.emplace_back(std::move(cb));
+        }
+        wakeup();
+    }
+    size_t consumeAll()
+    {
+        std::vector<Functor> functors;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            functors.swap(pending_);
+        }
+        for (const Functor &functor : functors)
+        {
+            functor();
+        }
+        return functors.size();
+    }
+    void wakeup()
+    {
+        uint64_t one = 1;
+        ::write(fd, &one, sizeof one);
+        ++wakeups;
+    }
+
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    std::atomic<long> wakeups{0};
+
+private:
+    std::mutex mutex_;
+    std::vector<Functor> pending_;
+};
+
+// 新的实现
+class LockFreeQueue
+{
+public:
+    void push(Functor cb)
+    {
+        queue_.push(std::move(cb));
+        if (!wakeupPending_.exchange(true))
+        {
+            wakeup();
+        }
+    }
+    size_t consumeAll()
+    {
+        wakeupPending_.exchange(false);
+        return queue_.consumeAll([](Functor &functor) { functor(); });
+    }
+    void wakeup()
+    {
+        uint64_t one = 1;
+        ::write(fd, &one, sizeof one);
+        ++wakeups;
+    }
+
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    std::atomic<long> wakeups{0};
+
+private:
+    MpscQueue<Functor> queue_;
+    std::atomic_bool wakeupPending_{false};
+};
+
+// 模拟EventLoop：阻塞在eventfd上，被唤醒后执行所有回调
+template <typename Queue>
+static void runQueue(const char *name, int producers, long total)
+{
+    Queue queue;
+    long executed = 0;
+    long per = total / producers;
+    long expect = per * producers;
+
+    int64_t start = nowUs();
+    std::thread consumer([&] {
+        pollfd pfd;
+        pfd.fd = queue.fd;
+        pfd.events = POLLIN;
+        while (executed < expect)
+        {
+            ::poll(&pfd, 1, 100);
+            uint64_t n;
+            ::read(queue.fd, &n, sizeof n);
+            executed += queue.consumeAll();
+        }
+    });
+    std::vector<std::thread> threads;
+    std::atomic<long> counter(0);
+    for (int i = 0; i < producers; ++i)
+    {
+        threads.emplace_back([&] {
+            for (long j = 0; j < per; ++j)
+            {
+                queue.push([&counter] { counter.fetch_add(1, std::memory_order_relaxed); });
+            }
+        });
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    consumer.join();
+    int64_t elapsed = nowUs() - start;
+    printf("%-10s producers=%2d tasks=%ld  %8.0f ktasks/s  eventfd writes=%ld\n",
+           name, producers, expect, expect * 1000.0 / elapsed, queue.wakeups.load());
+}
+
+// 直接使用EventLoop::queueINLoop
+static void runEventLoop(int producers, long total)
+{
+    EventLoopThread thread;
+    EventLoop *loop = thread.startLoop();
+    long per = total / producers;
+    long expect = per * producers;
+    std::atomic<long> counter(0);
+
+    int64_t start = nowUs();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i)
+    {
+        threads.emplace_back([&] {
+            for (long j = 0; j < per; ++j)
+            {
+                loop->queueINLoop([&counter] { counter.fetch_add(1, std::memory_order_relaxed); });
+            }
+        });
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    while (counter.load() < expect)
+    {
+        std::this_thread::yield();
+    }
+    int64_t elapsed = nowUs() - start;
+    printf("%-10s producers=%2d tasks=%ld  %8.0f ktasks/s\n",
+           "EventLoop", producers, expect, expect * 1000.0 / elapsed);
+}
+
+int main(int argc, char *argv[])
+{
+    long total = argc > 1 ? atol(argv[1]) : 1000000;
+    for (int producers = 1; producers <= 32; producers *= 2)
+    {
+        runQueue<MutexQueue>("mutex", producers, total);
+        runQueue<LockFreeQueue>("mpsc", producers, total);
+        runEventLoop(producers, total);
+    }
+    return 0;
+}
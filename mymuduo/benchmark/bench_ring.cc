@@ -0,0 +1,141 @@
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/EventLoopThreadPool.h>
+#include <mymuduo/LoopMesh.h>
+
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+/**
+ * 比较两个loop之间发送消息的两种方式：
+ *  queueINLoop : 每条消息包装成一个回调投递到目标loop
+ *  LoopMesh    : 消息放入两个loop之间的SPSC环形队列，每批只通知一次
+ * 发送方在自己的loop线程中每次发送batch条消息，然后投递一个回调在下一轮继续发送
+ * 用法：./bench_ring [消息总数] [每批消息数]
+ */
+
+struct Message
+{
+    int64_t key;
+    int64_t value;
+};
+
+static int64_t nowUs()
+{
+    return Timestamp::now().microSecondsSinceEpoch();
+}
+
+// 接收方的计数，只在接收方loop线程中修改
+static std::atomic<long> received(0);
+
+static void waitReceived(long total)
+{
+    while (received.load(std::memory_order_relaxed) < total)
+    {
+        std::this_thread::yield();
+    }
+}
+
+class FunctorSender
+{
+public:
+    FunctorSender(EventLoop *from, EventLoop *to, long total, int batch)
+        : from_(from), to_(to), left_(total), batch_(batch), sum_(0) {}
+
+    void run()
+    {
+        for (int i = 0; i < batch_ && left_ > 0; ++i, --left_)
+        {
+            Message message = {left_, left_ * 2};
+            int64_t *sum = &sum_;
+            to_->queueINLoop([message, sum] {
+                *sum += message.value;
+                received.store(received.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            });
+        }
+        if (left_ > 0)
+        {
+            from_->queueINLoop([this] { run(); });
+        }
+    }
+
+private:
+    EventLoop *from_;
+    EventLoop *to_;
+    long left_;
+    int batch_;
+    int64_t sum_; // 只在接收方修改
+};
+
+class RingSender
+{
+public:
+    RingSender(LoopMesh<Message> *mesh, long total, int batch)
+        : mesh_(mesh), left_(total), batch_(batch), fullCount_(0) {}
+
+    void run()
+    {
+        for (int i = 0; i < batch_ && left_ > 0; ++i)
+        {
+            Message message = {left_, left_ * 2};
+            if (!mesh_->send(0, 1, message))
+            { // 队列满了，下一轮再发
+                ++fullCount_;
+                break;
+            }
+            --left_;
+        }
+        if (left_ > 0)
+        {
+            mesh_->loop(0)->queueINLoop([this] { run(); });
+        }
+    }
+    long fullCount() const { return fullCount_; }
+
+private:
+    LoopMesh<Message> *mesh_;
+    long left_;
+    int batch_;
+    long fullCount_;
+};
+
+int main(int argc, char *argv[])
+{
+    long total = argc > 1 ? atol(argv[1]) : 10000000;
+    int batch = argc > 2 ? atoi(argv[2]) : 256;
+
+    EventLoop baseLoop;
+    EventLoopThreadPool pool(&baseLoop, "bench");
+    pool.setThreadNum(2);
+    pool.start();
+    std::vector<EventLoop *> loops = pool.getAllLoops();
+
+    for (int round = 0; round < 3; ++round)
+    {
+        received = 0;
+        FunctorSender functorSender(loops[0], loops[1], total, batch);
+        int64_t start = nowUs();
+        loops[0]->runInLoop([&functorSender] { functorSender.run(); });
+        waitReceived(total);
+        int64_t elapsed = nowUs() - start;
+        printf("%-12s messages=%ld batch=%d  %8.0f kmsg/s\n",
+               "queueINLoop", total, batch, total * 1000.0 / elapsed);
+
+        received = 0;
+        int64_t sum = 0;
+        LoopMesh<Message> mesh(loops, 4096, [&sum](int, Message &message) {
+            sum += message.value;
+            received.store(received.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        });
+        RingSender ringSender(&mesh, total, batch);
+        start = nowUs();
+        loops[0]->runInLoop([&ringSender] { ringSender.run(); });
+        waitReceived(total);
+        elapsed = nowUs() - start;
+        printf("%-12s messages=%ld batch=%d  %8.0f kmsg/s  ring full=%ld\n",
+               "LoopMesh", total, batch, total * 1000.0 / elapsed, ringSender.fullCount());
+    }
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include <mymuduo/TcpServer.h>
 #include <mymuduo/Logger.h>
+#include <mymuduo/SignalHandler.h>
 #include <string>
 /**
  * 使用mymuduo写一个简单的回响服务器
@@ -23,6 +24,11 @@ public:
     {
         mser.start(); // 启动监听listen
     }
+    // 优雅停止，最多等待5秒，所有连接关闭后退出loop
+    void stop()
+    {
+        mser.stop(5.0, std::bind(&EventLoop::quit, mloop));
+    }
 private:
     void onConnectionCallback(const TcpConnectionPtr& conn)
     {
@@ -58,6 +64,10 @@ int main()
     EventLoop loop;
     InetAddress localAddr(6000);
     EchoServer ser(&loop,localAddr,"EchoServer");
+    // 收到SIGINT/SIGTERM时优雅停止，要在start创建线程之前设置
+    SignalHandler signals(&loop);
+    signals.add(SIGINT, std::bind(&EchoServer::stop, &ser));
+    signals.add(SIGTERM, std::bind(&EchoServer::stop, &ser));
     ser.start();
     loop.loop();
     return 0;